@@ -12,6 +12,37 @@
 #define DYN_ALLOC_MIN_BLOCK_SIZE (1<<LOG2_MIN_SIZE)		//8 BYTE
 #define DYN_ALLOC_MAX_BLOCK_SIZE (1<<LOG2_MAX_SIZE) 	//2 KB
 
+//Block size classes: each power-of-two range (2^k, 2^(k+1)] is split into 2^DYN_ALLOC_SUBCLASS_BITS
+//equal steps (quarter-power steps: ..., 80, 96, 112, 128, 160, ...). Steps can't be smaller than
+//DYN_ALLOC_MIN_BLOCK_SIZE, so sizes up to DYN_ALLOC_LINEAR_MAX_SIZE step linearly by it (8, 16, ..., 64).
+//DYN_ALLOC_SUBCLASS_BITS = 0 gives the plain power-of-two classes (8, 16, 32, ..., 2048)
+#define DYN_ALLOC_SUBCLASS_BITS (2)
+#define LOG2_LINEAR_MAX_SIZE (LOG2_MIN_SIZE + DYN_ALLOC_SUBCLASS_BITS + 1)
+#define DYN_ALLOC_LINEAR_MAX_SIZE (1<<LOG2_LINEAR_MAX_SIZE)	//64 BYTE
+#define NUM_OF_LINEAR_CLASSES (DYN_ALLOC_LINEAR_MAX_SIZE / DYN_ALLOC_MIN_BLOCK_SIZE)
+#define NUM_OF_BLOCK_CLASSES (NUM_OF_LINEAR_CLASSES + ((LOG2_MAX_SIZE - LOG2_LINEAR_MAX_SIZE) << DYN_ALLOC_SUBCLASS_BITS))
+
+//Constant-time mapping between a size in [1, DYN_ALLOC_MAX_BLOCK_SIZE] and its freeBlockLists[] index
+static inline uint32 size_to_class(uint32 size)
+{
+	if (size <= DYN_ALLOC_MIN_BLOCK_SIZE)
+		return 0;
+	if (size <= DYN_ALLOC_LINEAR_MAX_SIZE)
+		return ((size - 1) >> LOG2_MIN_SIZE);
+	uint32 k = 31 - __builtin_clz(size - 1);	//size in (2^k, 2^(k+1)]
+	uint32 sub = ((size - 1) >> (k - DYN_ALLOC_SUBCLASS_BITS)) - (1 << DYN_ALLOC_SUBCLASS_BITS);
+	return NUM_OF_LINEAR_CLASSES + ((k - LOG2_LINEAR_MAX_SIZE) << DYN_ALLOC_SUBCLASS_BITS) + sub;
+}
+static inline uint32 class_to_size(uint32 class)
+{
+	if (class < NUM_OF_LINEAR_CLASSES)
+		return (class + 1) << LOG2_MIN_SIZE;
+	class -= NUM_OF_LINEAR_CLASSES;
+	uint32 k = LOG2_LINEAR_MAX_SIZE + (class >> DYN_ALLOC_SUBCLASS_BITS);
+	uint32 sub = class & ((1 << DYN_ALLOC_SUBCLASS_BITS) - 1);
+	return (1 << k) + ((sub + 1) << (k - DYN_ALLOC_SUBCLASS_BITS));
+}
+
 //////////////////by yomna///////////////////
 //uint32 mapStoI[DYN_ALLOC_MAX_BLOCK_SIZE+1];
 
@@ -21,7 +52,7 @@ struct BlockElement
 	LIST_ENTRY(BlockElement) prev_next_info;	/* linked list links */
 };
 LIST_HEAD(BlockElement_List, BlockElement);
-struct BlockElement_List freeBlockLists[LOG2_MAX_SIZE - LOG2_MIN_SIZE + 1] ;
+struct BlockElement_List freeBlockLists[NUM_OF_BLOCK_CLASSES] ;
 
 struct PageInfoElement
 {
@@ -37,6 +68,28 @@ struct PageInfoElement pageBlockInfoArr[DYN_ALLOC_MAX_SIZE/PAGE_SIZE];
 uint32 dynAllocStart;
 uint32 dynAllocEnd;
 
+//[4] Empty-page cache: up to dynAllocMaxEmptyPages pages per size class whose blocks are all
+//free stay mapped (with their blocks on freeBlockLists[]) instead of being returned at once
+#define DYN_ALLOC_DEFAULT_EMPTY_PAGES 0
+uint32 dynAllocMaxEmptyPages;
+uint32 dynAllocNumOfEmptyPages[NUM_OF_BLOCK_CLASSES];
+
+//[5] Extra arenas: once the main DA window [dynAllocStart, dynAllocEnd) runs out of pages, the DA
+//claims DYN_ALLOC_ARENA_SIZE-byte extents from the page allocator (get_arena()). Each arena keeps its
+//own PageInfoElement table in its first pages; the rest of its pages join freePagesList.
+//The table is appended under the lock of the DA but read without it: dynAllocNumOfArenas is
+//written only after the new entry is filled in (see dynamic_allocator.c)
+#define DYN_ALLOC_MAX_ARENAS 32
+#define DYN_ALLOC_ARENA_SIZE (4<<20)					//4 MB
+struct DAArena
+{
+	uint32 start;									//VA of the first block page (after the table)
+	uint32 num_of_pages;							//# block pages
+	struct PageInfoElement *pageInfoArr;			//table of the block pages (at the arena start)
+};
+struct DAArena dynAllocArenas[DYN_ALLOC_MAX_ARENAS];
+uint32 dynAllocNumOfArenas;
+
 /*FUNCTIONS*/
 //=============================================================================
 /*2025*/ //GIVEN FUNCTIONS
@@ -47,6 +100,7 @@ __inline__ struct PageInfoElement * to_page_info(uint32 va);
 //USER: implemented inside kern/mem/uheap.c
 int get_page(void* va);		//get a page from the Kernel Page Allocator for DA (i.e. Allocate it)
 void return_page(void* va);	//return a page from the DA to Kernel Page Allocator (i.e. Free It)
+void* get_arena(uint32 size);	//reserve (without mapping) a page-aligned VA extent for a new DA arena. NULL if none
 //=============================================================================
 
 /*2025*/ //REQUIRED FUNCTIONS
@@ -54,6 +108,8 @@ void initialize_dynamic_allocator(uint32 daStart, uint32 daEnd);
 void *alloc_block(uint32 size);
 void free_block(void* va);
 __inline__ uint32 get_block_size(void *va);
+void set_dynamic_allocator_empty_pages(uint32 maxEmptyPages);
+struct DAArena* get_dynamic_allocator_arena(uint32 va);
 
 /*2025*/ //BONUS FUNCTIONS
 void *realloc_block(void* va, uint32 new_size);
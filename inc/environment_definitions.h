@@ -60,6 +60,7 @@ uint32 old_pf_counter;
 struct WorkingSetElement {
 	unsigned int virtual_address;
 	uint8 empty;
+	uint8 prefetched;			//fault-around: paged in ahead of a fault and not found used yet
 	//2012
 	unsigned int time_stamp ;
 
@@ -73,11 +74,17 @@ struct WorkingSetElement {
 LIST_HEAD(WS_List, WorkingSetElement);		// Declares 'struct WS_list'
 
 /*2025*/
-struct PageRefElement {
-	unsigned int virtual_address;
-	LIST_ENTRY(PageRefElement) prev_next_info;	// list link pointers
+//Stream of page references, run-length encoded: consecutive references to the same page are one run
+struct PageRefRun {
+	unsigned int page_number;	// VA >> PGSHIFT
+	unsigned int count;			// # of consecutive references to this page
+};
+struct PageRefStream {
+	struct PageRefRun *runs;
+	unsigned int num_runs;
+	unsigned int max_runs;		// # of runs allocated
+	unsigned int num_refs;		// total # of references
 };
-LIST_HEAD(PageRef_List, PageRefElement);		// Declares 'struct PageRef_List'
 
 //======================================================================
 
@@ -145,7 +152,11 @@ struct Env {
 #if USE_KHEAP
 	struct WS_List page_WS_list ;					//List of WS elements
 	struct WorkingSetElement* page_last_WS_element;	//ptr to last inserted WS element
-	struct PageRef_List referenceStreamList;		//List of page references stream to be used for OPTIMAL replacement strategy
+	struct WorkingSetElement* page_WS_ring;			//Contiguous storage of the WS elements (page_WS_max_size slots)
+	struct WS_List page_WS_free_slots;				//Unused slots of page_WS_ring
+	struct PageRefStream referenceStream;			//Stream of page references (RLE) to be used for OPTIMAL replacement strategy
+	uint32 *optimal_active_VAs;						//OPTIMAL: pages kept present till the next reset (page_WS_max_size slots)
+	uint32 optimal_num_active;						//OPTIMAL: # of optimal_active_VAs
 	uint32 *prepagedVAs;							//Initial virtual addresses after fetching the process into RAM
 	uint32 numOfPrepagedVAs;						//Number of prepaged VAs
 #else
@@ -191,6 +202,9 @@ struct Env {
 	uint32 env_runs;			// Number of times environment has run
 	//2020
 	uint32 nPageIn, nPageOut, nNewPageAdded;
+	uint32 nPageReclaimed;		// soft faults: buffered pages taken back without a page-in
+	uint32 nPagePrefetched;		// fault-around: neighbour pages paged in with a faulted one
+	uint32 nPrefetchHits;		// fault-around: prefetched pages found used afterwards
 	uint32 nClocks ;
 
 };
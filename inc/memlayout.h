@@ -216,6 +216,13 @@ struct FrameInfo {
 	uint16 references;
 	struct Env *proc;
 	unsigned char isBuffered;
+	// buffering: the user VA (of proc) whose page this buffered frame still holds
+	uint32 va;
+	// buddy allocator: set on the first frame of a free block of 2^buddy_order frames
+	uint8 buddy_free;
+	uint8 buddy_order;
+	// reverse map: the kernel heap VA this frame is mapped at (0 if it's not a kernel heap frame)
+	uint32 kheap_va;
 };
 
 #endif /* !__ASSEMBLER__ */
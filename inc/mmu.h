@@ -65,6 +65,7 @@
 #define PERM_USED		0x020	// Accessed
 #define PERM_MODIFIED	0x040	// Dirty
 #define PTE_PS			0x080	// Page Size
+#define PERM_GLOBAL		0x100	// Global: kept in the TLB across CR3 reloads (needs CR4_PGE)
 #define PTE_MBZ			0x180	// Bits must be zero
 #define PERM_BUFFERED 	0x200 	//Page is buffered
 #define PERM_UHPAGE 	0x400 	//Page in User Heap
@@ -93,6 +94,7 @@
 #define CR0_PG		0x80000000	// Paging
 
 #define CR4_PCE		0x00000100	// Performance counter enable
+#define CR4_PGE		0x00000080	// Page Global Enable
 #define CR4_MCE		0x00000040	// Machine Check Enable
 #define CR4_PSE		0x00000010	// Page Size Extensions
 #define CR4_DE		0x00000008	// Debugging Extensions
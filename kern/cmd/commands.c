@@ -15,7 +15,9 @@
 #include <kern/tests/utilities.h>
 #include "../cpu/sched.h"
 #include "../disk/pagefile_manager.h"
+#include <inc/dynamic_allocator.h>
 #include "../mem/kheap.h"
+#include "../mem/kmem_cache.h"
 #include "../mem/memory_manager.h"
 #include "../tests/tst_handler.h"
 #include "../tests/utilities.h"
@@ -41,6 +43,7 @@ struct Command commands[] =
 		{ "ikb", "Lab3.Example: shows mapping info of KERNEL_BASE" ,command_kernel_base_info, 0},
 		{ "dkb", "Lab3.Example: delete the mapping of KERNEL_BASE" ,command_del_kernel_base, 0},
 		{ "meminfo", "display info about RAM", command_meminfo, 0},
+		{ "buddyinfo", "display the free blocks and the fragmentation of the buddy frame allocator", command_buddyinfo, 0},
 		{"sched?", "print current scheduler algorithm", command_print_sch_method, 0},
 		{"runall", "run all loaded programs", command_run_all, 0},
 		{"printall", "print all loaded programs", command_print_all, 0},
@@ -68,6 +71,7 @@ struct Command commands[] =
 		{"nomodbuff", "disable modified buffer", command_disable_modified_buffer, 0},
 		{"modbuff", "enable modified buffer", command_enable_modified_buffer, 0},
 		{"modbufflength?", "get modified buffer length", command_get_modified_buffer_length, 0},
+		{"faultaround?", "get the fault-around window (# neighbour pages prefetched on a page fault)", command_get_fault_around_window, 0},
 		{"cls", "clear screen", command_cls, 0},
 
 		//*****************************//
@@ -86,6 +90,8 @@ struct Command commands[] =
 		{"schedTest", "Used for turning on/off the scheduler test", command_sch_test, 1},
 		{"lru", "set replacement algorithm to LRU", command_set_page_rep_LRU, 1},
 		{"modbufflength", "set the length of the modified buffer", command_set_modified_buffer_length, 1},
+		{"faultaround", "set the fault-around window (# neighbour pages prefetched on a page fault, 0 to disable)", command_set_fault_around_window, 1},
+		{"dapages", "set the max # of empty DA pages cached per block size of the kernel heap", command_set_kheap_empty_pages, 1},
 		{ "setStarvThr", "set the the starvation threshold of priority scheduler", command_set_starve_thresh, 1},
 
 		//******************************//
@@ -598,10 +604,41 @@ int command_meminfo(int number_of_arguments, char **arguments)
 			counters.freeBuffered+ counters.freeNotBuffered+ counters.modified, counters.freeBuffered, counters.freeNotBuffered, counters.modified);
 
 	cprintf("Num of calls for kheap_virtual_address [in last run] = %d\n", numOfKheapVACalls);
+	cprintf("Pre-zeroed frames = %d, allocate_zeroed_frame hits = %d, misses = %d\n",
+			LIST_SIZE(&MemFrameLists.zeroed_frame_list), zeroedPoolHits, zeroedPoolMisses);
 
 	return 0;
 }
 
+//Per order: # free blocks and the unusable free index (% of the free frames of the buddies that
+//are in smaller blocks, i.e. that can't serve an allocation of this order)
+int command_buddyinfo(int number_of_arguments, char **arguments)
+{
+	uint32 num_of_blocks[BUDDY_MAX_ORDER + 1];
+	uint32 num_free;
+	acquire_kspinlock(&MemFrameLists.mfllock);
+	{
+		for (int order = 0; order <= BUDDY_MAX_ORDER; order++)
+			num_of_blocks[order] = LIST_SIZE(&MemFrameLists.buddy_free_area[order]);
+		num_free = MemFrameLists.buddy_num_free;
+	}
+	release_kspinlock(&MemFrameLists.mfllock);
+
+	int largest_order = -1;
+	uint32 num_usable = 0;
+	cprintf("Order\tFree Blocks\tUnusable Free Index\n");
+	for (int order = BUDDY_MAX_ORDER; order >= 0; order--)
+	{
+		if (num_of_blocks[order] > 0 && largest_order < 0)
+			largest_order = order;
+		num_usable += num_of_blocks[order] << order;
+		cprintf("%d\t%d\t\t%d%%\n", order, num_of_blocks[order],
+				num_free == 0 ? 100 : ((num_free - num_usable) * 100) / num_free);
+	}
+	cprintf("Free frames in the buddies = %d, largest free order = %d\n", num_free, largest_order);
+	return 0;
+}
+
 //2020
 struct Env * CreateEnv(int number_of_arguments, char **arguments)
 {
@@ -1121,10 +1158,32 @@ int command_print_kheap_plac(int number_of_arguments, char **arguments)
 	default:
 		cprintf("Kernel Heap placement strategy is UNDEFINED\n");
 	}
+	cprintf("Kernel Heap metadata nodes: %d in use, peak = %d, capacity = %d, exhausted %d time(s)\n",
+			kheapNodesInUse, kheapNodesPeakInUse, MAX_KHEAP_PAGES_COUNT, kheapNodesExhausted);
+	struct kheapMagazineStats mag;
+	kheap_magazine_stats(&mag);
+	uint32 allocs = mag.alloc_hits + mag.alloc_misses;
+	uint32 frees = mag.free_hits + mag.free_misses;
+	cprintf("Kernel Heap block magazines: alloc hits = %d/%d (%d%%), free hits = %d/%d (%d%%)\n",
+			mag.alloc_hits, allocs, allocs ? mag.alloc_hits * 100 / allocs : 0,
+			mag.free_hits, frees, frees ? mag.free_hits * 100 / frees : 0);
+	kmem_cache_print_stats();
+	cprintf("Kernel Heap empty block pages cached per size: max = %d\n", dynAllocMaxEmptyPages);
+	cprintf("Kernel Heap block arenas beyond the DA window = %d (%d KB each)\n", dynAllocNumOfArenas, DYN_ALLOC_ARENA_SIZE / 1024);
 
 	return 0;
 }
 
+int command_set_kheap_empty_pages(int number_of_arguments, char **arguments)
+{
+	acquire_kspinlock(&kheap_spinlock);
+	kheap_magazines_drain();
+	set_dynamic_allocator_empty_pages(strtol(arguments[1], NULL, 10));
+	release_kspinlock(&kheap_spinlock);
+	cprintf("Kernel Heap empty block pages cached per size updated = %d\n", dynAllocMaxEmptyPages);
+	return 0;
+}
+
 /*2017*///END======================================================
 
 int command_disable_modified_buffer(int number_of_arguments, char **arguments)
@@ -1212,6 +1271,19 @@ int command_get_modified_buffer_length(int number_of_arguments, char **arguments
 	return 0;
 }
 
+int command_set_fault_around_window(int number_of_arguments, char **arguments)
+{
+	setFaultAroundWindow(strtol(arguments[1], NULL, 10));
+	cprintf("Fault-around window updated = %d\n", getFaultAroundWindow());
+	return 0;
+}
+
+int command_get_fault_around_window(int number_of_arguments, char **arguments)
+{
+	cprintf("Fault-around window = %d\n", getFaultAroundWindow());
+	return 0;
+}
+
 int command_tst(int number_of_arguments, char **arguments)
 {
 	return tst_handler(number_of_arguments, arguments);
@@ -85,6 +85,7 @@ int command_readuserblock(int number_of_arguments, char **arguments);
 int command_remove_table(int number_of_arguments, char **arguments);
 int command_allocuserpage(int number_of_arguments, char **arguments);
 int command_meminfo(int number_of_arguments, char **arguments);
+int command_buddyinfo(int number_of_arguments, char **arguments);
 //2023
 int command_tst(int number_of_arguments, char **arguments);
 
@@ -114,6 +115,8 @@ int command_disable_buffering(int number_of_arguments, char **arguments);
 int command_enable_buffering(int number_of_arguments, char **arguments);
 int command_set_modified_buffer_length(int number_of_arguments, char **arguments);
 int command_get_modified_buffer_length(int number_of_arguments, char **arguments);
+int command_set_fault_around_window(int number_of_arguments, char **arguments);
+int command_get_fault_around_window(int number_of_arguments, char **arguments);
 
 //USER HEAP Commands
 //======================
@@ -133,6 +136,7 @@ int command_set_kheap_plac_NEXTFIT(int number_of_arguments, char **arguments);
 int command_set_kheap_plac_WORSTFIT(int number_of_arguments, char **arguments);
 int command_set_kheap_plac_CUSTOMFIT(int number_of_arguments, char **arguments);
 int command_print_kheap_plac(int number_of_arguments, char **arguments);
+int command_set_kheap_empty_pages(int number_of_arguments, char **arguments);
 
 //SCHEDULER Commands
 //======================
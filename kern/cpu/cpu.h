@@ -10,6 +10,11 @@
 #include <inc/mmu.h>
 #include <inc/memlayout.h>
 // Per-CPU state
+
+// Per-CPU cache of hot (recently freed) frames in front of the order-0 buddy blocks:
+// refilled by CPU_HOT_FRAMES_BATCH frames when empty, drained by the same when full
+#define CPU_HOT_FRAMES_MAX		32
+#define CPU_HOT_FRAMES_BATCH	16
 struct cpu {
   unsigned char apicid;			// Local APIC ID
   struct Context *scheduler;   	// context_switch() here to enter scheduler
@@ -22,6 +27,8 @@ struct cpu {
   int intena;                  	// Were interrupts enabled before pushcli? (for locking)
   struct Env *proc;           	// The process running on this cpu or null
   int scheduler_status ;		// Status of the scheduler at this CPU
+  struct FrameInfo* hot_frames[CPU_HOT_FRAMES_MAX];	// clean free frames, the hottest on top
+  uint32 num_hot_frames;
 };
 
 struct cpu CPUS[NCPUS] ;
@@ -145,6 +145,10 @@ fos_scheduler(void)
 		}
 		release_kspinlock(&ProcessQueues.qlock);  //release lock: to protect ready & blocked Qs in multi-CPU
 		//cprintf("\n[FOS_SCHEDULER] release: lock status after = %d\n", qlock.locked);
+
+		//Nothing is ready to run: use the idle time to zero some free frames ahead
+		if (is_any_blocked)
+			zeroed_frames_pool_refill(ZEROED_FRAMES_IDLE_BATCH);
 	} while (is_any_blocked > 0);
 
 	/*2015*///No more envs... curenv doesn't exist any more! return back to command prompt
@@ -449,9 +453,10 @@ void clock_interrupt_handler(struct Trapframe* tf)
 //===================================================================
 void update_WS_time_stamps()
 {
-	//TODO: [PROJECT'25.IM#6] FAULT HANDLER II - #1 update_WS_time_stamps
-	//Your code is here
-	//Comment the following line
-	panic("update_WS_time_stamps is not implemented yet...!!");
-
+	struct Env* cur_env = get_cpu_proc();
+	if (cur_env == NULL)
+		return;
+#if USE_KHEAP
+	env_page_ws_age_step(cur_env);
+#endif
 }
@@ -48,6 +48,30 @@ int write_disk_page(uint32 dfn, void* va)
 	return success;
 }
 
+//Write 'num_of_pages' (<= PAGE_FILE_MAX_CLUSTER_PAGES) consecutive disk frames starting at 'dfn'
+//from the buffer at 'va' by a single disk command
+int write_disk_pages(uint32 dfn, void* va, uint32 num_of_pages)
+{
+	assert(num_of_pages > 0 && num_of_pages <= PAGE_FILE_MAX_CLUSTER_PAGES);
+	uint32 df_start_sector = PAGE_FILE_START_SECTOR+dfn*SECTOR_PER_PAGE;
+
+	int success = ide_write(df_start_sector, (void*)va, num_of_pages * SECTOR_PER_PAGE);
+
+	if(success != 0)
+		panic("Error writing on disk\n");
+	return success;
+}
+
+//Read 'num_of_pages' (<= PAGE_FILE_MAX_CLUSTER_PAGES) consecutive disk frames starting at 'dfn'
+//into the buffer at 'va' by a single disk command
+int read_disk_pages(uint32 dfn, void* va, uint32 num_of_pages)
+{
+	assert(num_of_pages > 0 && num_of_pages <= PAGE_FILE_MAX_CLUSTER_PAGES);
+	uint32 df_start_sector = PAGE_FILE_START_SECTOR+dfn*SECTOR_PER_PAGE;
+
+	return ide_read(df_start_sector, (void*)va, num_of_pages * SECTOR_PER_PAGE);
+}
+
 ///========================== PAGE FILE MANAGMENT ==============================
 
 uint32* ptr_disk_page_directory;
@@ -267,15 +291,13 @@ int pf_add_env_page( struct Env* ptr_env, uint32 virtual_address, void* dataSrc)
 	return ret;
 }
 
-int pf_update_env_page(struct Env* ptr_env, uint32 virtual_address, struct FrameInfo* modified_page_frame_info)
+//Return the disk frame of the given env page to update, after adding it to the page file
+//if it's a new page of the USER HEAP or USER STACK
+uint32 pf_get_env_page_dfn_to_update(struct Env* ptr_env, uint32 virtual_address)
 {
 	int ret;
 	uint32 *ptr_disk_page_table;
-	//ROUND DOWN it on 4 KB boundary in order to update the entire page starting from its first address.
-	//virtual_address = ROUNDDOWN(virtual_address, PAGE_SIZE);
 
-	assert((uint32)virtual_address < KERNEL_BASE);
-	//char c = *((char*)virtual_address);
 	//Get/Create the directory table
 	get_disk_page_directory(ptr_env, &(ptr_env->disk_env_pgdir)) ;
 
@@ -338,7 +360,18 @@ int pf_update_env_page(struct Env* ptr_env, uint32 virtual_address, struct Frame
 
 
 	get_disk_page_table(ptr_env->disk_env_pgdir, virtual_address, 0, &ptr_disk_page_table);
-	uint32 dfn=ptr_disk_page_table[PTX(virtual_address)];
+	return ptr_disk_page_table[PTX(virtual_address)];
+}
+
+int pf_update_env_page(struct Env* ptr_env, uint32 virtual_address, struct FrameInfo* modified_page_frame_info)
+{
+	int ret;
+	//ROUND DOWN it on 4 KB boundary in order to update the entire page starting from its first address.
+	//virtual_address = ROUNDDOWN(virtual_address, PAGE_SIZE);
+
+	assert((uint32)virtual_address < KERNEL_BASE);
+	//char c = *((char*)virtual_address);
+	uint32 dfn = pf_get_env_page_dfn_to_update(ptr_env, virtual_address);
 
 #if USE_KHEAP
 	{
@@ -380,6 +413,8 @@ int pf_update_env_page(struct Env* ptr_env, uint32 virtual_address, struct Frame
 		ptrTable[PTX(virtual_address)] |= origPerms ;
 		//5. Clear modified bit
 		ptrTable[PTX(virtual_address)] &= ~PERM_MODIFIED;
+		//6. Drop the translation cached by the write (it may be NOT PRESENT again)
+		tlb_invalidate(ptr_env->env_page_directory, (void*)virtual_address);
 
 //		cprintf("[%s] updating page at va %x\n",ptr_env->prog_name, virtual_address);
 	}
@@ -443,6 +478,38 @@ int pf_read_env_page(struct Env* ptr_env, void* virtual_address)
 	return disk_read_error;
 }
 
+//Return the disk frame # of the page at 'virtual_address' of the env, 0 if it's not in the page
+//file (nothing is created)
+uint32 pf_get_env_page_dfn(struct Env* ptr_env, uint32 virtual_address)
+{
+	uint32 *ptr_disk_page_table;
+	if( ptr_env->disk_env_pgdir == 0) return 0;
+
+	get_disk_page_table(ptr_env->disk_env_pgdir, virtual_address, 0, &ptr_disk_page_table);
+	if(ptr_disk_page_table == 0) return 0;
+
+	return ptr_disk_page_table[PTX(virtual_address)];
+}
+
+//Read 'num_of_pages' pages of the env, starting at 'virtual_address', by a single disk command.
+//Their disk frames must be consecutive (see pf_get_env_page_dfn) and they must be mapped
+int pf_read_env_pages(struct Env* ptr_env, uint32 virtual_address, uint32 num_of_pages)
+{
+	virtual_address = ROUNDDOWN(virtual_address, PAGE_SIZE);
+	uint32 dfn = pf_get_env_page_dfn(ptr_env, virtual_address);
+	if( dfn == 0) return E_PAGE_NOT_EXIST_IN_PF;
+
+	int disk_read_error = read_disk_pages(dfn, (void*)virtual_address, num_of_pages);
+
+	//reset modified bits to 0 (as in pf_read_env_page)
+	for (uint32 i = 0; i < num_of_pages; i++)
+		pt_set_page_permissions(ptr_env->env_page_directory, virtual_address + i * PAGE_SIZE, 0, PERM_MODIFIED);
+
+	ptr_env->nPageIn += num_of_pages;
+
+	return disk_read_error;
+}
+
 void pf_remove_env_page(struct Env* ptr_env, uint32 virtual_address)
 {
 	//LOG_STRING("pf_remove_env_page: 0");
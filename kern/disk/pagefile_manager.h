@@ -15,6 +15,7 @@
 
 #define PAGE_FILE_SIZE (520 << 20)   	//page file size in MB
 #define PAGES_PER_FILE (PAGE_FILE_SIZE/PAGE_SIZE)
+#define PAGE_FILE_MAX_CLUSTER_PAGES (256/SECTOR_PER_PAGE)	//max # pages written by one disk command
 
 ///=============================================================================================
 struct FrameInfo* disk_frames_info;
@@ -28,8 +29,13 @@ struct
 int pf_add_empty_env_page( struct Env* ptr_env, uint32 virtual_address, uint8 initializeByZero);
 int pf_add_env_page( struct Env* ptr_env, uint32 virtual_address, void* dataSrc);
 int pf_update_env_page(struct Env* ptr_env, uint32 virtual_address, struct FrameInfo* modified_page_frame_info);
+uint32 pf_get_env_page_dfn_to_update(struct Env* ptr_env, uint32 virtual_address);
+int write_disk_pages(uint32 dfn, void* va, uint32 num_of_pages);
 //int pf_special_update_env_modified_page(struct Env* ptr_env, uint32 virtual_address, struct Frame_Info* page_modified_frame_info);
 int pf_read_env_page(struct Env* ptr_env, void* virtual_address);
+int read_disk_pages(uint32 dfn, void* va, uint32 num_of_pages);
+uint32 pf_get_env_page_dfn(struct Env* ptr_env, uint32 virtual_address);
+int pf_read_env_pages(struct Env* ptr_env, uint32 virtual_address, uint32 num_of_pages);
 void pf_remove_env_page(struct Env* ptr_env, uint32 virtual_address);
 ///=============================================================================================
 
@@ -19,6 +19,8 @@
 #include <kern/cpu/cpu.h>
 #include <kern/mem/boot_memory_manager.h>
 #include <kern/mem/kheap.h>
+#include <kern/mem/kmem_cache.h>
+#include <kern/mem/working_set_manager.h>
 #include <kern/mem/memory_manager.h>
 #include <kern/mem/shared_memory_manager.h>
 #include <kern/tests/utilities.h>
@@ -74,7 +76,10 @@ void FOS_initialize()
 		initialize_paging();
 #if USE_KHEAP
 		kheap_init();
+		zeroed_frames_pool_init();
+		kmem_cache_init();
 		sharing_init();
+		env_page_ws_caches_init();
 #endif
 		fault_handler_init();
 		set_uheap_strategy(UHP_PLACE_CUSTOMFIT);
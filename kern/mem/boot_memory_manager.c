@@ -96,7 +96,7 @@ void initialize_kernel_VM()
 	//Ensure that the total size of SCHED Kernel Stack for ALL CPUs is less than PTSIZE (specified area for them)
 	assert(NCPUS*KERNEL_STACK_SIZE < PTSIZE);
 
-	boot_map_range(ptr_page_directory, KERN_STACK_TOP - NCPUS*KERNEL_STACK_SIZE, NCPUS*KERNEL_STACK_SIZE, STATIC_KERNEL_PHYSICAL_ADDRESS(ptr_stack_bottom), PERM_WRITEABLE) ;
+	boot_map_range(ptr_page_directory, KERN_STACK_TOP - NCPUS*KERNEL_STACK_SIZE, NCPUS*KERNEL_STACK_SIZE, STATIC_KERNEL_PHYSICAL_ADDRESS(ptr_stack_bottom), PERM_WRITEABLE | PERM_GLOBAL) ;
 	//set bottom page of each stack as a GUARD page
 	for (int c = 0; c < NCPUS; ++c)
 	{
@@ -109,7 +109,7 @@ void initialize_kernel_VM()
 	//      the PA range [0, 2^32 - KERNEL_BASE)
 	// We might not have 2^32 - KERNEL_BASE bytes of physical memory, but
 	// we just set up the mapping anyway.
-	// Permissions: kernel RW, user NONE
+	// Permissions: kernel RW, user NONE (GLOBAL: the kernel half is shared by all address spaces)
 	// Your code goes here:
 
 	//2016:
@@ -185,11 +185,11 @@ void initialize_kernel_VM()
 		// MAKE SURE THAT THIS MAPPING HAPPENS AFTER ALL BOOT ALLOCATIONS (boot_allocate_space)
 		// calls are fininshed, and no remaining data to be allocated for the kernel
 		// map all used pages so far for the kernel
-		boot_map_range(ptr_page_directory, KERNEL_BASE, (uint32)ptr_free_mem - KERNEL_BASE, 0, PERM_WRITEABLE) ;
+		boot_map_range(ptr_page_directory, KERNEL_BASE, (uint32)ptr_free_mem - KERNEL_BASE, 0, PERM_WRITEABLE | PERM_GLOBAL) ;
 	}
 #else
 	{
-		boot_map_range(ptr_page_directory, KERNEL_BASE, 0xFFFFFFFF - KERNEL_BASE, 0, PERM_WRITEABLE) ;
+		boot_map_range(ptr_page_directory, KERNEL_BASE, 0xFFFFFFFF - KERNEL_BASE, 0, PERM_WRITEABLE | PERM_GLOBAL) ;
 	}
 #endif
 	// Check that the initial page directory has been set up correctly.
@@ -451,6 +451,12 @@ void turn_on_paging()
 	// Flush the TLB for good measure, to kill the ptr_page_directory[0] mapping.
 	lcr3(phys_page_directory);
 
+	// Enable global pages only now: the temporary low mapping above shares the kernel's
+	// (global) page tables, so its entries would otherwise survive the CR3 reload.
+	// From here on, kernel mappings stay in the TLB across context switches; changing
+	// them must be followed by invlpg (tlb_invalidate), since a CR3 reload won't drop them.
+	lcr4(rcr4() | CR4_PGE);
+
 }
 
 void setup_listing_to_all_page_tables_entries()
@@ -27,10 +27,16 @@ char* ptr_free_mem;					// Pointer to next byte of free mem
 //struct FrameInfo* disk_frames_info;	// Virtual address of physical frames_info array
 struct FrameInfo* frames_info;		// Virtual address of physical frames_info array
 
+#define BUDDY_MAX_ORDER	10	// largest block of the buddy allocator: 2^10 frames (4 MB)
+
 struct
 {
-	struct FrameInfo_List free_frame_list;		// Free list of physical frames_info
+	struct FrameInfo_List buddy_free_area[BUDDY_MAX_ORDER + 1];	// Free blocks of 2^order clean frames (by order)
+	uint32 buddy_num_free;						// # frames in all buddy blocks (maintained with them)
+	struct FrameInfo_List free_frame_list;		// Free list of buffered frames (still holding their page)
 	struct FrameInfo_List modified_frame_list;	// Modified frame list for buffering
+	uint32 num_free_buffered;					// # buffered frames on free_frame_list (maintained with it)
+	struct FrameInfo_List zeroed_frame_list;	// Free frames already filled by zeros (refilled while idle)
 	struct kspinlock mfllock;					// Lock to protect the frame info lists
 } MemFrameLists;
 
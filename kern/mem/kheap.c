@@ -9,10 +9,15 @@
 #include <inc/mmu.h>
 #include <inc/queue.h>
 #include "../conc/kspinlock.h"
+#include "../cpu/cpu.h"
 
 
 #define MAX_KHEAP_PAGES  ((kheapPageAllocBreak - kheapPageAllocStart) / PAGE_SIZE)
 
+// Kernel heap pages are the same in every address space: map them global so that
+// their TLB entries survive the CR3 reload of a context switch
+#define KHEAP_PAGE_PERMS (PERM_WRITEABLE | PERM_GLOBAL)
+
 //==================================================================================//
 //============================== GLOBAL VARIABLES ==================================//
 //==================================================================================//
@@ -29,6 +34,12 @@ struct kMetadata_free_list kheap_metadata_free_list;
 
 static kheapMetadata kheap_nodes[MAX_KHEAP_PAGES_COUNT];
 
+// VA -> metadata index of the page allocator: one slot per page of
+// [kheapPageAllocStart, KERNEL_HEAP_MAX), set at the start page of each live allocation
+static kheapMetadata* kheap_va_map[MAX_KHEAP_PAGES_COUNT];
+
+static kheapMetadata* kheap_place_pages(uint32 size_to_allocate, uint32 map_from);
+
 //==================================================================================//
 //============================== GIVEN FUNCTIONS ===================================//
 //==================================================================================//
@@ -83,7 +94,7 @@ void kheap_init()
 //==============================================
 int get_page(void* va)
 {
-    int ret = alloc_page(ptr_page_directory, ROUNDDOWN((uint32)va, PAGE_SIZE), PERM_WRITEABLE, 1);
+    int ret = alloc_page(ptr_page_directory, ROUNDDOWN((uint32)va, PAGE_SIZE), KHEAP_PAGE_PERMS, 1);
     if (ret < 0)
         panic("get_page() in kern: failed to allocate page from the kernel");
     return 0;
@@ -97,46 +108,288 @@ void return_page(void* va)
     unmap_frame(ptr_page_directory, ROUNDDOWN((uint32)va, PAGE_SIZE));
 }
 
+//==============================================
+// [4] GET AN ARENA FROM THE KERNEL FOR DA:
+//==============================================
+// Reserve a page-allocator extent (nothing mapped) for an extra DA arena. NULL if the heap is full
+void* get_arena(uint32 size)
+{
+    if (!USE_KHEAP)
+        return NULL;    // the page allocator isn't initialized (DA tests own the heap area)
+    return kheap_reserve_pages(size);
+}
+
 //==================================================================================//
 //============================ REQUIRED FUNCTIONS ==================================//
 //==================================================================================//
 
+// O(1) lookup of the live page allocation that starts at va (NULL if none)
+static inline kheapMetadata* kheap_va_lookup(uint32 va)
+{
+    if (va < kheapPageAllocStart || va >= KERNEL_HEAP_MAX || (va & (PAGE_SIZE - 1)))
+        return NULL;
+    return kheap_va_map[(va - kheapPageAllocStart) / PAGE_SIZE];
+}
+
+static inline void kheap_va_map_set(uint32 va, kheapMetadata* node)
+{
+    kheap_va_map[(va - kheapPageAllocStart) / PAGE_SIZE] = node;
+}
+
+// Whether va is a DA block: inside the main DA window or inside one of its extra arenas
+static inline int kheap_is_block_va(uint32 va)
+{
+    return va < kheapPageAllocStart || get_dynamic_allocator_arena(va) != NULL;
+}
+
+
+//==================================================================================//
+//============================== METADATA NODE POOL ================================//
+//==================================================================================//
+// Released nodes are recycled through kheap_metadata_free_list; nodes never used before
+// are handed out from kheap_nodes[] by a bump index. Both are O(1).
+static uint32 kheap_nodes_next_unused = 0;
 
 kheapMetadata* find_available_node(){
-    uint32 max_index = MAX_KHEAP_PAGES_COUNT;
-///
-    for (uint32 i = 0; i < max_index; i++) {
-        if (kheap_nodes[i].is_used == 0) { //use -1 instead of 0 gives page fault even tho its initialized by -1???
-            return &kheap_nodes[i];///////////WARNING!!!! WHEN KFREEING OR KMALLOC WE DONT UPDATE THE KHEAP_NODES[]
-        }
+    kheapMetadata *node = LIST_FIRST(&kheap_metadata_free_list);
+    if (node != NULL) {
+        LIST_REMOVE(&kheap_metadata_free_list, node);
+    } else if (kheap_nodes_next_unused < MAX_KHEAP_PAGES_COUNT) {
+        node = &kheap_nodes[kheap_nodes_next_unused++];
+    } else {
+        kheapNodesExhausted++;
+        return NULL;
     }
-    return NULL;
+    node->is_used = 1;
+    if (++kheapNodesInUse > kheapNodesPeakInUse)
+        kheapNodesPeakInUse = kheapNodesInUse;
+    return node;
 }
 
+// return a node that is no longer in kheap_list/kheap_allocated_list to the pool
+void release_node(kheapMetadata *node)
+{
+    node->va = -1;
+    node->size = 0;
+    node->is_used = 0;
+    LIST_INSERT_HEAD(&kheap_metadata_free_list, node);
+    kheapNodesInUse--;
+}
 
 
-// insert sorted free region
 
-void insert_sorted_free_region(kheapMetadata *free_node)
+//==================================================================================//
+//============================== FREE-EXTENT INDEX =================================//
+//==================================================================================//
+// Free extents of the page allocator live in kheap_list (sorted by VA) and, through the
+// same nodes, in two treaps so that every placement strategy is answered in O(log n):
+//   KH_ADDR_TREE: keyed by va; each node caches the largest extent size in its subtree
+//   KH_SIZE_TREE: keyed by (size, va)
+#define KH_ADDR_TREE 0
+#define KH_SIZE_TREE 1
+
+static kheapMetadata* kh_root[2];
+static uint32 kheapNextFitVA;
+
+static inline uint32 kh_priority(kheapMetadata* n)
+{
+    return ((uint32)n >> 2) * 2654435761u;
+}
+
+static inline int kh_less(int t, kheapMetadata* a, kheapMetadata* b)
 {
-    kheapMetadata *iter = LIST_FIRST(&kheap_list);
+    if (t == KH_SIZE_TREE && a->size != b->size)
+        return a->size < b->size;
+    return a->va < b->va;
+}
 
-    // If list is empty, just insert
-    if (!iter) {
-        LIST_INSERT_TAIL(&kheap_list, free_node);
+static inline void kh_update(int t, kheapMetadata* n)
+{
+    if (t != KH_ADDR_TREE)
+        return;
+    unsigned int max = n->size;
+    if (n->tree_left[t] && n->tree_left[t]->max_size > max)
+        max = n->tree_left[t]->max_size;
+    if (n->tree_right[t] && n->tree_right[t]->max_size > max)
+        max = n->tree_right[t]->max_size;
+    n->max_size = max;
+}
+
+// split "root" into the nodes ordered before "key" (*l) and the rest (*r)
+static void kh_split(int t, kheapMetadata* root, kheapMetadata* key, kheapMetadata** l, kheapMetadata** r)
+{
+    if (root == NULL) {
+        *l = *r = NULL;
         return;
     }
+    if (kh_less(t, root, key)) {
+        kh_split(t, root->tree_right[t], key, &root->tree_right[t], r);
+        *l = root;
+    } else {
+        kh_split(t, root->tree_left[t], key, l, &root->tree_left[t]);
+        *r = root;
+    }
+    kh_update(t, root);
+}
 
-    // Find the position to insert (sorted by VA)
-    while (iter && (uint32)iter->va < (uint32)free_node->va) {
-        iter = LIST_NEXT(iter);
+static kheapMetadata* kh_merge(int t, kheapMetadata* l, kheapMetadata* r)
+{
+    if (l == NULL) return r;
+    if (r == NULL) return l;
+    if (kh_priority(l) > kh_priority(r)) {
+        l->tree_right[t] = kh_merge(t, l->tree_right[t], r);
+        kh_update(t, l);
+        return l;
     }
+    r->tree_left[t] = kh_merge(t, l, r->tree_left[t]);
+    kh_update(t, r);
+    return r;
+}
+
+static kheapMetadata* kh_insert(int t, kheapMetadata* root, kheapMetadata* n)
+{
+    if (root == NULL || kh_priority(n) > kh_priority(root)) {
+        kh_split(t, root, n, &n->tree_left[t], &n->tree_right[t]);
+        kh_update(t, n);
+        return n;
+    }
+    if (kh_less(t, n, root))
+        root->tree_left[t] = kh_insert(t, root->tree_left[t], n);
+    else
+        root->tree_right[t] = kh_insert(t, root->tree_right[t], n);
+    kh_update(t, root);
+    return root;
+}
+
+static kheapMetadata* kh_erase(int t, kheapMetadata* root, kheapMetadata* n)
+{
+    if (root == NULL)
+        panic("kheap: free extent [%x, +%x) is not in the index", n->va, n->size);
+    if (root == n)
+        return kh_merge(t, n->tree_left[t], n->tree_right[t]);
+    if (kh_less(t, n, root))
+        root->tree_left[t] = kh_erase(t, root->tree_left[t], n);
+    else
+        root->tree_right[t] = kh_erase(t, root->tree_right[t], n);
+    kh_update(t, root);
+    return root;
+}
 
-    if (iter) {
-        LIST_INSERT_BEFORE(&kheap_list, iter, free_node);
+// lowest-address extent that starts at or after "start" and fits "size"
+static kheapMetadata* kh_first_fit(kheapMetadata* t, uint32 start, unsigned int size)
+{
+    if (t == NULL || t->max_size < size)
+        return NULL;
+    if (t->va >= start) {
+        kheapMetadata* found = kh_first_fit(t->tree_left[KH_ADDR_TREE], start, size);
+        if (found != NULL)
+            return found;
+        if (t->size >= size)
+            return t;
+    }
+    return kh_first_fit(t->tree_right[KH_ADDR_TREE], start, size);
+}
+
+// smallest extent that fits "size" (lowest address among equal sizes)
+static kheapMetadata* kh_best_fit(unsigned int size)
+{
+    kheapMetadata *t = kh_root[KH_SIZE_TREE], *best = NULL;
+    while (t != NULL) {
+        if (t->size >= size) {
+            best = t;
+            t = t->tree_left[KH_SIZE_TREE];
+        } else {
+            t = t->tree_right[KH_SIZE_TREE];
+        }
+    }
+    return best;
+}
+
+// largest extent if it fits "size" (lowest address among equal sizes)
+static kheapMetadata* kh_worst_fit(unsigned int size)
+{
+    kheapMetadata *t = kh_root[KH_SIZE_TREE];
+    if (t == NULL)
+        return NULL;
+    while (t->tree_right[KH_SIZE_TREE] != NULL)
+        t = t->tree_right[KH_SIZE_TREE];
+    if (t->size < size)
+        return NULL;
+    return kh_best_fit(t->size);
+}
+
+static kheapMetadata* kh_addr_predecessor(uint32 va)
+{
+    kheapMetadata *t = kh_root[KH_ADDR_TREE], *pred = NULL;
+    while (t != NULL) {
+        if (t->va < va) {
+            pred = t;
+            t = t->tree_right[KH_ADDR_TREE];
+        } else {
+            t = t->tree_left[KH_ADDR_TREE];
+        }
+    }
+    return pred;
+}
+
+// choose a free extent for "size" bytes according to kheapPlacementStrategy (NULL: extend the break)
+static kheapMetadata* kheap_find_free_extent(unsigned int size)
+{
+    kheapMetadata* found;
+    switch (kheapPlacementStrategy) {
+    case KHP_PLACE_FIRSTFIT:
+        return kh_first_fit(kh_root[KH_ADDR_TREE], 0, size);
+    case KHP_PLACE_NEXTFIT:
+        found = kh_first_fit(kh_root[KH_ADDR_TREE], kheapNextFitVA, size);
+        if (found == NULL)
+            found = kh_first_fit(kh_root[KH_ADDR_TREE], 0, size);
+        return found;
+    case KHP_PLACE_BESTFIT:
+        return kh_best_fit(size);
+    case KHP_PLACE_WORSTFIT:
+        return kh_worst_fit(size);
+    case KHP_PLACE_CUSTOMFIT:
+        // exact fit, otherwise worst fit
+        found = kh_best_fit(size);
+        if (found != NULL && found->size == size)
+            return found;
+        return kh_worst_fit(size);
+    default:
+        // KHP_PLACE_CONTALLOC: always allocate at the break
+        return NULL;
+    }
+}
+
+// insert sorted free region
+
+void insert_sorted_free_region(kheapMetadata *free_node)
+{
+    kheapMetadata *pred = kh_addr_predecessor(free_node->va);
+    if (pred) {
+        LIST_INSERT_AFTER(&kheap_list, pred, free_node);
     } else {
-        LIST_INSERT_TAIL(&kheap_list, free_node);
+        LIST_INSERT_HEAD(&kheap_list, free_node);
     }
+    kh_root[KH_ADDR_TREE] = kh_insert(KH_ADDR_TREE, kh_root[KH_ADDR_TREE], free_node);
+    kh_root[KH_SIZE_TREE] = kh_insert(KH_SIZE_TREE, kh_root[KH_SIZE_TREE], free_node);
+}
+
+void remove_free_region(kheapMetadata *free_node)
+{
+    kh_root[KH_ADDR_TREE] = kh_erase(KH_ADDR_TREE, kh_root[KH_ADDR_TREE], free_node);
+    kh_root[KH_SIZE_TREE] = kh_erase(KH_SIZE_TREE, kh_root[KH_SIZE_TREE], free_node);
+    LIST_REMOVE(&kheap_list, free_node);
+}
+
+// change the bounds of a free region without changing its order in kheap_list
+static void resize_free_region(kheapMetadata *free_node, uint32 va, unsigned int size)
+{
+    kh_root[KH_ADDR_TREE] = kh_erase(KH_ADDR_TREE, kh_root[KH_ADDR_TREE], free_node);
+    kh_root[KH_SIZE_TREE] = kh_erase(KH_SIZE_TREE, kh_root[KH_SIZE_TREE], free_node);
+    free_node->va = va;
+    free_node->size = size;
+    kh_root[KH_ADDR_TREE] = kh_insert(KH_ADDR_TREE, kh_root[KH_ADDR_TREE], free_node);
+    kh_root[KH_SIZE_TREE] = kh_insert(KH_SIZE_TREE, kh_root[KH_SIZE_TREE], free_node);
 }
 
 
@@ -146,180 +399,302 @@ void merge_free_block(kheapMetadata *free_node)
 {
     kheapMetadata *prev = LIST_PREV(free_node);
     kheapMetadata *next = LIST_NEXT(free_node);
+    uint32 va = free_node->va;
+    unsigned int size = free_node->size;
 
-    if (prev && ((uint32)prev->va + prev->size == (uint32)free_node->va)) {
-        prev->size += free_node->size;
-        LIST_REMOVE(&kheap_list, free_node);
-        free_node->va=-1; //become free again
+    if (prev && ((uint32)prev->va + prev->size == va)) {
+        remove_free_region(free_node);
+        release_node(free_node);
         free_node = prev;
+        va = prev->va;
+        size += prev->size;
+    }
+
+    if (next && (va + size == (uint32)next->va)) {
+        size += next->size;
+        remove_free_region(next);
+        release_node(next);
     }
 
-    next = LIST_NEXT(free_node);
-    if (next && ((uint32)free_node->va + free_node->size == (uint32)next->va)) {
-        free_node->size += next->size;
-        LIST_REMOVE(&kheap_list, next);
-        next->va=-1;
+    if (va != free_node->va || size != free_node->size) {
+        resize_free_region(free_node, va, size);
     }
 }
 
 
-//===================================
-// [1] ALLOCATE SPACE IN KERNEL HEAP:
-//===================================
-void* kmalloc(unsigned int size)
+//==================================================================================//
+//============================ PAGE ALLOCATOR HELPERS ==============================//
+//==================================================================================//
+// All of them must be called with kheap_spinlock held
+
+// Reserve "size_to_allocate" bytes of VA (by the placement strategy, or at the break), map frames
+// to its pages starting from offset "map_from" and track it as allocated.
+// Returns its node, or NULL with nothing changed.
+static kheapMetadata* kheap_place_pages(uint32 size_to_allocate, uint32 map_from)
 {
-    acquire_kspinlock(&kheap_spinlock);
-  // cprintf("kmalloc called size=%u\n", size);
-    //cprintf("kheapPageAllocBreak = %x, KERNEL_HEAP_MAX = %x\n", kheapPageAllocBreak, KERNEL_HEAP_MAX);
+    uint32 num_of_pages = (size_to_allocate - map_from) / PAGE_SIZE;
+    kheapMetadata* allocated_metadata = NULL;
+
+    // Search the free-extent index of kheap_list
+    kheapMetadata* block_to_allocate = kheap_find_free_extent(size_to_allocate);
+
+    if (block_to_allocate != NULL) {
+        uint32 allocated_va = block_to_allocate->va;  // Save this FIRST!
+        unsigned int remaining_size = block_to_allocate->size - size_to_allocate;
+
+        // the remainder needs its own node: fail before touching the free extent
+        kheapMetadata *new_free = NULL;
+        if (remaining_size > 0) {
+            new_free = find_available_node();
+            if (new_free == NULL)
+                return NULL;
+        }
 
+        // Map all frames at once (nothing is mapped on failure)
+        if (allocate_and_map_frames(ptr_page_directory, allocated_va + map_from, num_of_pages, KHEAP_PAGE_PERMS) != 0) {
+            if (new_free != NULL)
+                release_node(new_free);
+            return NULL;
+        }
 
-    if (size == 0) {
-        release_kspinlock(&kheap_spinlock);
+        remove_free_region(block_to_allocate);
+        block_to_allocate->size = size_to_allocate;
+
+        if (remaining_size > 0) {
+            // the remainder stays between the new block and a used one, so it needs no merging
+            new_free->va = allocated_va + size_to_allocate;
+            new_free->size = remaining_size;
+            insert_sorted_free_region(new_free);
+        }
+        allocated_metadata = block_to_allocate;
+    }
+    // Break line extension
+    else if (size_to_allocate <= KERNEL_HEAP_MAX - kheapPageAllocBreak) {
+        kheapMetadata* new_metadata = find_available_node();
+        if (new_metadata == NULL)
+            return NULL;
+        if (allocate_and_map_frames(ptr_page_directory, kheapPageAllocBreak + map_from, num_of_pages, KHEAP_PAGE_PERMS) != 0) {
+            release_node(new_metadata);
+            return NULL;
+        }
+        new_metadata->va = kheapPageAllocBreak;
+        new_metadata->size = size_to_allocate;
+        kheapPageAllocBreak += size_to_allocate; // Advance break
+        allocated_metadata = new_metadata;
+    }
+    else {
         return NULL;
     }
 
-    // Block Allocator
-    if (size <= DYN_ALLOC_MAX_BLOCK_SIZE) {
-        void* allocated_address = alloc_block(size);
-        release_kspinlock(&kheap_spinlock);
-        return allocated_address;
+    LIST_INSERT_TAIL(&kheap_allocated_list, allocated_metadata);
+    kheap_va_map_set(allocated_metadata->va, allocated_metadata);
+    kheapNextFitVA = allocated_metadata->va + allocated_metadata->size;
+    return allocated_metadata;
+}
+
+static void kheap_untrack_pages(kheapMetadata *node)
+{
+    kheap_va_map_set(node->va, NULL);
+    LIST_REMOVE(&kheap_allocated_list, node);
+}
+
+// Give [free_node->va, +free_node->size) back: unmap (and free) its frames, coalesce it
+// into kheap_list and pull the break down if the resulting extent ends at it
+static void kheap_release_pages(kheapMetadata *free_node)
+{
+    // Unmap all pages (unmap_frame clears the reverse map, drops the last reference and frees the frame)
+    for (uint32 va = free_node->va; va < free_node->va + free_node->size; va += PAGE_SIZE) {
+        if (kheap_physical_address(va) != 0)
+            unmap_frame(ptr_page_directory, va);
     }
 
-    // Page Allocator
-    else {
-        uint32 size_to_allocate = ROUNDUP(size, PAGE_SIZE);
-        kheapMetadata* allocated_metadata = NULL;
-        kheapMetadata* best_worst_fit_metadata = NULL;
-
-        // Search in kheap_list
-        kheapMetadata* current_metadata = LIST_FIRST(&kheap_list);
-        while (current_metadata != NULL) {
-            // Exact Fit
-            if (current_metadata->size == size_to_allocate) {
-                best_worst_fit_metadata = current_metadata;
-                break;
-            }
-
-            // Worst Fit
-            if (current_metadata->size > size_to_allocate) {
-                if (best_worst_fit_metadata == NULL ||
-                    current_metadata->size > best_worst_fit_metadata->size) {
-                    best_worst_fit_metadata = current_metadata;
-                }
-            }
-            current_metadata = LIST_NEXT(current_metadata);
+    insert_sorted_free_region(free_node);
+    merge_free_block(free_node);
+
+    // kheap_list is sorted by VA, so only its last block can end at the break
+    kheapMetadata *last_free = LIST_LAST(&kheap_list);
+    if (last_free && last_free->va + last_free->size == kheapPageAllocBreak) {
+        // Move break down
+        kheapPageAllocBreak = last_free->va;
+
+        // Remove this free block from the list and return the node
+        remove_free_region(last_free);
+        release_node(last_free);
+    }
+}
+
+// Move the frames of [from_va, +size) to [to_va, +size) by rewriting their PTEs (no copy).
+// The destination pages must be unmapped.
+static void kheap_move_pages(uint32 from_va, uint32 to_va, uint32 size)
+{
+    uint32 *from_table = NULL, *to_table = NULL;
+    for (uint32 offset = 0; offset < size; offset += PAGE_SIZE) {
+        uint32 from = from_va + offset, to = to_va + offset;
+        if (from_table == NULL || PTX(from) == 0)
+            get_page_table(ptr_page_directory, from, &from_table);
+        if (to_table == NULL || PTX(to) == 0)
+            get_page_table(ptr_page_directory, to, &to_table);
+
+        uint32 entry = from_table[PTX(from)];
+        if (!(entry & PERM_PRESENT))
+            continue;
+        to_table[PTX(to)] = (to_table[PTX(to)] & PERM_AVAILABLE) | (entry & ~PERM_AVAILABLE);
+        from_table[PTX(from)] = entry & PERM_AVAILABLE;
+        tlb_invalidate(ptr_page_directory, (void*)from);
+        to_frame_info(EXTRACT_ADDRESS(entry))->kheap_va = to;
+    }
+}
+
+//==================================================================================//
+//============================== BLOCK MAGAZINES ===================================//
+//==================================================================================//
+// Per-CPU stacks of ready blocks for each size class in front of alloc_block/free_block.
+// A hit touches neither kheap_spinlock nor freeBlockLists[] (only interrupts are disabled).
+// Magazines are filled only by kfree: an alloc miss takes a single block from the DA, a free
+// miss drains KHEAP_MAG_BATCH blocks back to it under kheap_spinlock.
+struct kheapMagazine
+{
+    uint32 count;
+    void* rounds[KHEAP_MAG_CAPACITY];
+};
+static struct kheapMagazine kheap_magazines[NCPUS][NUM_OF_BLOCK_CLASSES];
+static struct kheapMagazineStats kheap_mag_stats[NCPUS];
+
+// Give the blocks of the magazines of CPU 'c' back to the DA. Called with kheap_spinlock held
+// and, to be safe against the lock-free hit paths, either on CPU 'c' with interrupts disabled
+// or while no other CPU uses the kernel heap
+static void kheap_magazines_drain_cpu(int c)
+{
+    for (int class = 0; class < NUM_OF_BLOCK_CLASSES; class++) {
+        struct kheapMagazine *mag = &kheap_magazines[c][class];
+        while (mag->count > 0)
+            free_block(mag->rounds[--mag->count]);
+    }
+}
+
+static void* kheap_magazine_alloc(uint32 size)
+{
+    uint32 class = size_to_class(size);
+    void* va;
+
+    pushcli();
+    {
+        int c = mycpu() - CPUS;
+        struct kheapMagazine *mag = &kheap_magazines[c][class];
+        if (mag->count > 0) {
+            va = mag->rounds[--mag->count];
+            kheap_mag_stats[c].alloc_hits++;
+            popcli();
+            return va;
         }
+        kheap_mag_stats[c].alloc_misses++;
+    }
+    popcli();
 
-        if (best_worst_fit_metadata != NULL) {
-            kheapMetadata* block_to_allocate = best_worst_fit_metadata;
-            uint32 allocated_va = block_to_allocate->va;  // Save this FIRST!
-            unsigned int original_size = block_to_allocate->size;
-            unsigned int remaining_size = original_size - size_to_allocate;
-
-            LIST_REMOVE(&kheap_list, block_to_allocate);
-
-            // Update the allocated block's metadata
-            block_to_allocate->size = size_to_allocate;  //  ADD THIS!
-
-            if (remaining_size > 0) {
-                kheapMetadata *new_free = find_available_node();
-
-                new_free->va = allocated_va + size_to_allocate;  // Use saved VA
-                new_free->size = remaining_size;
-                new_free->is_used = 1;
-                insert_sorted_free_region(new_free);
-                merge_free_block(new_free);
-            }
-
-            // Map frames using the SAVED VA and size_to_allocate
-            for (uint32 va = allocated_va;
-                 va < allocated_va + size_to_allocate;
-                 va += PAGE_SIZE) {
-                struct FrameInfo *frame;
-                int ret = allocate_frame(&frame);
-                if (ret != 0) {
-                    panic("Failed to allocate frame\n");
-                }
-                if (frame == NULL) {
-                    release_kspinlock(&kheap_spinlock);
-                    return NULL;
-                }
-                uint32 permissions = PERM_PRESENT | PERM_WRITEABLE;
-                map_frame(ptr_page_directory, frame, va, permissions);
-
-             //   frame_to_va[to_frame_number(frame)] = va;
-            }
-
-            LIST_INSERT_TAIL(&kheap_allocated_list, block_to_allocate);
-            allocated_metadata = block_to_allocate;
-           // LIST_REMOVE(&kheap_list, block_to_allocate);//////tb2a ahker haga hena
+    acquire_kspinlock(&kheap_spinlock);
+    {
+        va = alloc_block(class_to_size(class));
+        // blocks parked in this CPU's magazines may hold the pages the DA is missing
+        if (va == NULL) {
+            pushcli();
+            kheap_magazines_drain_cpu(mycpu() - CPUS);
+            popcli();
+            va = alloc_block(class_to_size(class));
         }
+    }
+    release_kspinlock(&kheap_spinlock);
+    return va;
+}
 
-        // Break line extension
-							if (allocated_metadata == NULL) {
-								//cprintf("size to allocate********",size_to_allocate,"********");
-								if (size_to_allocate > KERNEL_HEAP_MAX - kheapPageAllocBreak) {
-								    release_kspinlock(&kheap_spinlock);
-								    return NULL;
-								}
-								if (size_to_allocate <= KERNEL_HEAP_MAX - kheapPageAllocBreak) {
-							     kheapMetadata* new_metadata = find_available_node();
-                                 //cprintf("IMMM HERREEE AT THE ALLLOCCC BREAKKKK");
-							 	  if (new_metadata != NULL) {
-					               uint32 new_va_start = kheapPageAllocBreak;
-
-												// 1. Configure the new allocated metadata node
-
-								                new_metadata->va =new_va_start;
-												new_metadata->size = size_to_allocate;
-												new_metadata->is_used = 1;
-												kheapPageAllocBreak += size_to_allocate; // Advance break
-
-
-										for (uint32 va = new_va_start;
-											 va < new_va_start + size_to_allocate;
-											 va += PAGE_SIZE) {
-											struct FrameInfo *frame;
-											int ret = allocate_frame(&frame);
-											if (ret != 0) {
-												panic("Failed to allocate frame\n");
-											}
-
-											if (frame == NULL) {
-												release_kspinlock(&kheap_spinlock);
-												return NULL;
-											}
-											uint32 permissions = PERM_PRESENT | PERM_WRITEABLE;
-											 map_frame(ptr_page_directory, frame, va, permissions);
-											 frame_to_va[to_frame_number(frame)] = va;
-										}
-
-							LIST_INSERT_TAIL(&kheap_allocated_list, new_metadata);
-					allocated_metadata = new_metadata;
-								  }
-									}
-
-								}
-
-
-      //if (allocated_metadata) cprintf("allocated va=%x size=%u\n", allocated_metadata->va, allocated_metadata->size);
-     //  else cprintf("kmalloc returning NULL (no metadata)\n");
+static void kheap_magazine_free(void* va)
+{
+    uint32 class = size_to_class(get_block_size(va));
+
+    pushcli();
+    {
+        int c = mycpu() - CPUS;
+        struct kheapMagazine *mag = &kheap_magazines[c][class];
+        if (mag->count < KHEAP_MAG_CAPACITY) {
+            mag->rounds[mag->count++] = va;
+            kheap_mag_stats[c].free_hits++;
+            popcli();
+            return;
+        }
+        kheap_mag_stats[c].free_misses++;
+    }
+    popcli();
+
+    acquire_kspinlock(&kheap_spinlock);
+    {
+        // drain a batch back to the DA and keep the freed block warm
+        struct kheapMagazine *mag = &kheap_magazines[mycpu() - CPUS][class];
+        while (mag->count > KHEAP_MAG_CAPACITY - KHEAP_MAG_BATCH)
+            free_block(mag->rounds[--mag->count]);
+        mag->rounds[mag->count++] = va;
+    }
+    release_kspinlock(&kheap_spinlock);
+}
+
+// Give the blocks of the magazines of all CPUs back to the DA, so that the free block lists and
+// the empty-page reclamation see them again. The magazines of the other CPUs are emptied behind
+// their lock-free hit paths: for quiescent callers only (tests, the dapages command)
+void kheap_magazines_drain(void)
+{
+    bool lck = 0;
+    if (!holding_kspinlock(&kheap_spinlock)) {
+        acquire_kspinlock(&kheap_spinlock);
+        lck = 1;
+    }
+    pushcli();
+    for (int c = 0; c < NCPUS; c++)
+        kheap_magazines_drain_cpu(c);
+    popcli();
+    if (lck)
         release_kspinlock(&kheap_spinlock);
+}
 
-            return (void*)allocated_metadata->va;
+void kheap_magazine_stats(struct kheapMagazineStats *total)
+{
+    memset(total, 0, sizeof(*total));
+    for (int c = 0; c < NCPUS; c++) {
+        total->alloc_hits += kheap_mag_stats[c].alloc_hits;
+        total->alloc_misses += kheap_mag_stats[c].alloc_misses;
+        total->free_hits += kheap_mag_stats[c].free_hits;
+        total->free_misses += kheap_mag_stats[c].free_misses;
+    }
+}
+
+//===================================
+// [1] ALLOCATE SPACE IN KERNEL HEAP:
+//===================================
+void* kmalloc(unsigned int size)
+{
+    if (size == 0) {
+        return NULL;
+    }
 
+    // Block Allocator
+    if (size <= DYN_ALLOC_MAX_BLOCK_SIZE) {
+        return kheap_magazine_alloc(size);
     }
+
+    // Page Allocator
+    acquire_kspinlock(&kheap_spinlock);
+    kheapMetadata* allocated_metadata = kheap_place_pages(ROUNDUP(size, PAGE_SIZE), 0);
+    release_kspinlock(&kheap_spinlock);
+
+    if (allocated_metadata == NULL)
+        return NULL;
+    return (void*)allocated_metadata->va;
 }
 
 
 // Find VA size
 unsigned int find_va_size(uint32 target_va)
 {
-    kheapMetadata *element;
-    LIST_FOREACH_SAFE(element, &kheap_allocated_list, kheapMetadata) {
-        if (element->va == target_va) {
-            return element->size;
-        }
+    kheapMetadata *element = kheap_va_lookup(target_va);
+    if (element != NULL) {
+        return element->size;
     }
     return 0;
 }
@@ -328,85 +703,23 @@ unsigned int find_va_size(uint32 target_va)
 
 void kfree(void* virtual_address)
 {
-	acquire_kspinlock(&kheap_spinlock);
-    unsigned int va_size = find_va_size((uint32)virtual_address);
+    if (kheap_is_block_va((uint32)virtual_address)) {
+        // Block
+        kheap_magazine_free(virtual_address);
+        return;
+    }
 
-    if (va_size > DYN_ALLOC_MAX_BLOCK_SIZE) {
+	acquire_kspinlock(&kheap_spinlock);
+    {
         // Page
-    	kheapMetadata *free_node = NULL;
-    	kheapMetadata *element;
-
-    	//find node in alloc list
-    	LIST_FOREACH_SAFE(element, &kheap_allocated_list, kheapMetadata) {
-    	    if (element->va ==(uint32) virtual_address) {
-    	        free_node = element;                // this is the node we will reuse
-    	        LIST_REMOVE(&kheap_allocated_list, element);  // remove it
-    	        break;
-    	    }
-    	}
+    	kheapMetadata *free_node = kheap_va_lookup((uint32)virtual_address);
 
     	if (!free_node) {
     	    panic("Trying to free a virtual address that was not allocated!");
     	}
-
-    	// mark it as free
-    	//free_node->is_used = 0;
-
-
-        // Unmap all pages
-        for (uint32 va = (uint32)virtual_address;
-             va < (uint32)virtual_address + va_size;
-             va += PAGE_SIZE) {
-            unsigned int physical_address = kheap_physical_address(va);
-            if (physical_address != 0) {
-                struct FrameInfo *ptr_to_frame_info = to_frame_info(physical_address);
-                free_frame(ptr_to_frame_info);
-                frame_to_va[to_frame_number(ptr_to_frame_info)] = -1;
-                unmap_frame(ptr_page_directory, va);
-            }
-        }
-
-        insert_sorted_free_region(free_node);
-        merge_free_block(free_node);
-        while (1) {
-                   kheapMetadata *last_free = NULL;
-
-                   // Find the free block that ends exactly at kheapPageAllocBreak
-                   LIST_FOREACH(element, &kheap_list) {
-                       if (element->va + element->size == kheapPageAllocBreak) {
-                           last_free = element;
-                           break;
-                       }
-                   }
-
-                   if (last_free) {
-                       // Move break down
-                       kheapPageAllocBreak = last_free->va;
-
-                       // Remove this free block from the list and return the node
-                       LIST_REMOVE(&kheap_list, last_free);
-                       last_free->va = -1;  // Mark as available
-                       last_free->size = 0;
-                       last_free->is_used=0;
-                   } else {
-                       // No more free space at the end
-                       break;
-                   }
-               }
-
-    } else {
-        // Block
-        free_block(virtual_address);
+    	kheap_untrack_pages(free_node);
+    	kheap_release_pages(free_node);
     }
-
-  /*  // Remove from allocated list
-    kheapMetadata *element;
-    LIST_FOREACH_SAFE(element, &kheap_allocated_list, kheapMetadata) {
-        if (element->va == (uint32)virtual_address) {
-            LIST_REMOVE(&kheap_allocated_list, element);
-            break;
-        }
-    }*/
     release_kspinlock(&kheap_spinlock);
 }
 
@@ -429,13 +742,11 @@ unsigned int kheap_virtual_address(unsigned int physical_address)
         return 0;
     }
 
-    uint32 frame_number = to_frame_number(ptr_to_frame_info);
-
-    // Get the virtual address for this frame
-    uint32 VA = frame_to_va[frame_number];
+    // Get the virtual address for this frame from its reverse map
+    uint32 VA = ptr_to_frame_info->kheap_va;
 
     // Check if frame is not mapped in kernel heap (freed or never mapped)
-    if (VA == 0 || VA == (uint32)-1) {
+    if (VA == 0) {
         return 0;
     }
 
@@ -443,11 +754,39 @@ unsigned int kheap_virtual_address(unsigned int physical_address)
     return VA + offset;
 }
 
+//=================================
+// RESERVE KERNEL HEAP VA ONLY:
+//=================================
+// Reserve a page-aligned extent of the page allocator without mapping any frame to it
+// (its page tables exist since boot). It's given back by kfree(). NULL if the heap is full
+void* kheap_reserve_pages(unsigned int size)
+{
+    bool lck = 0;
+    if (!holding_kspinlock(&kheap_spinlock)) {
+        acquire_kspinlock(&kheap_spinlock);
+        lck = 1;
+    }
+    kheapMetadata* node = kheap_place_pages(ROUNDUP(size, PAGE_SIZE), ROUNDUP(size, PAGE_SIZE));
+    if (lck)
+        release_kspinlock(&kheap_spinlock);
+    return (node == NULL) ? NULL : (void*)node->va;
+}
+
 //=================================
 // [4] FIND PA OF GIVEN VA:
 //=================================
 unsigned int kheap_physical_address(unsigned int virtual_address)
 {
+    // Tables above KERNEL_BASE are shared by all directories: read the PTE through the VPT self-map
+    if (virtual_address >= KERNEL_BASE) {
+        if ((*vpd_entry(virtual_address) & PERM_PRESENT) == 0)
+            return 0;
+        uint32 PTE = *vpt_entry(virtual_address);
+        if ((PTE & PERM_PRESENT) == 0)
+            return 0;
+        return EXTRACT_ADDRESS(PTE) + PGOFF(virtual_address);
+    }
+
     uint32 PD_index = PDX(virtual_address);
     uint32 PDE = ptr_page_directory[PD_index];
 
@@ -478,276 +817,115 @@ unsigned int kheap_physical_address(unsigned int virtual_address)
 //============================== BONUS FUNCTION ===================================//
 //=================================================================================//
 
-//void *krealloc(void *virtual_address, uint32 new_size)
-//{
-//    // handle trivial cases: NULL and zero-size
-//    if (virtual_address == NULL) {
-//        return kmalloc(new_size);
-//    }
-//    if (new_size == 0) {
-//        kfree(virtual_address);
-//        return NULL;
-//    }
-//
-//    uint32 va = (uint32)virtual_address;
-//    uint32 old_size = (uint32) find_va_size(va);
-//
-//    if (old_size == new_size) return virtual_address;
-//
-//    // page to blocj or block to page
-//    bool old_is_block = (old_size <= DYN_ALLOC_MAX_BLOCK_SIZE);
-//    bool new_is_block = (new_size <= DYN_ALLOC_MAX_BLOCK_SIZE);
-//
-//    if (old_is_block != new_is_block) {
-//          kfree(virtual_address);
-//        void *n = kmalloc(new_size);
-//        if (!n) return NULL;
-//        return n;
-//    }
-//
-//    //  both are block
-//    if (old_is_block && new_is_block) {
-//        // shrinking or expanding within block subsystem:
-//        // Simpler approach: do not move memory.
-//        // If shrinking: just update metadata & map
-//        // If expanding: there is no simple safe in-place expand unless you check/merge adjacent free blocks.
-//        // We'll try to check for a free block immediately after this block within the same page only
-//        if (new_size < old_size) {
-//            // shrink: update size mapping and metadata
-//            // update metadata entry in allocated list if exists
-//            kheapMetadata *m = NULL;
-//            LIST_FOREACH_SAFE(m, &kheap_allocated_list, kheapMetadata) {
-//                if (m->va == va) {
-//                    m->size = new_size;
-//                    break;
-//                }
-//            }
-//            //we should unmap here or something i dont know or call free_block or kfree!!!!!!!1
-//            return virtual_address;
-//        } else { // enlargement
-//            // Attempting in-place expansion inside the same page is complex.
-//            // Fallback: allocate new region, free old (no memory move).
-//            void *n = kmalloc(new_size);
-//            //we should map here also but allocate block or just kmalloc
-//            if (!n) return NULL;
-//            kfree(virtual_address);
-//            return n;
-//        }
-//    }
-//
-//    //  both are page
-//    if (!old_is_block && !new_is_block) {
-//        // both are page-backed
-//        uint32 old_pages = ROUNDUP(old_size, PAGE_SIZE) / PAGE_SIZE;
-//        uint32 new_pages = ROUNDUP(new_size, PAGE_SIZE) / PAGE_SIZE;
-//
-//        //same num of pages
-//        if (new_pages == old_pages) {
-//            // update mapping and metadata
-//            kheapMetadata *meta = NULL;
-//            LIST_FOREACH_SAFE(meta, &kheap_allocated_list, kheapMetadata) {
-//                if (meta->va == va) {
-//                    meta->size = new_size;
-//                    break;
-//                }
-//            }
-//            return virtual_address;
-//        }
-//
-//        // SHRINKING
-//        if (new_pages < old_pages) {
-//            uint32 pages_to_free = old_pages - new_pages;
-//            uint32 free_start_va = va + new_pages * PAGE_SIZE; // first page to free
-//
-//             //unmap frames
-//            for (uint32 page_va = free_start_va; page_va < va + old_pages * PAGE_SIZE; page_va += PAGE_SIZE) {
-//                unsigned int physical_address = kheap_physical_address(page_va);
-//                if (physical_address != 0) {
-//                    struct FrameInfo *ptr_to_frame_info = to_frame_info(physical_address);
-//                    free_frame(ptr_to_frame_info);
-//                    frame_to_va[to_frame_number(ptr_to_frame_info)] = -1;
-//                    unmap_frame(ptr_page_directory, va);
-//            }
-//            }
-//
-//            // update size in allocated lisr
-//            kheapMetadata *meta = NULL;
-//            LIST_FOREACH_SAFE(meta, &kheap_allocated_list, kheapMetadata) {
-//                if (meta->va == va) {
-//                    meta->size = new_size;
-//                    break;
-//                }
-//            }
-//            //insert in kheap_free list
-//                        kheapMetadata *free_node =  find_available_node();
-//                        free_node->va=free_start_va;
-//                        free_node->size=old_size-new_size;
-//                        insert_sorted_free_region(free_node);
-//                        merge_free_block(free_node);
-//            // Optionally: create a kheapMetadata node for the freed pages and insert into kheap_list
-//            // (left out because your kheap free-page management functions were not pasted).
-//            return virtual_address;
-//        }
-//
-//        // STRETCHING (new_pages > old_pages)
-//        if (new_pages > old_pages) {
-//            uint32 need_pages = new_pages - old_pages;
-//            uint32 va_to_find = va + old_pages * PAGE_SIZE; // contiguous region right after current allocation
-//
-//            // Search kheap_list for a free metadata node starting exactly at candidate_va
-//            kheapMetadata *element = NULL, *tmp = NULL;
-//            LIST_FOREACH_SAFE(element, &kheap_list,kheapMetadata) {
-//                if (element->va == va_to_find) {
-//                    // element is free page chunk directly after allocation
-//                	//check the node's size
-//                    if (element->size >= need_pages * PAGE_SIZE) {
-//                        // We can try to allocate required frames/pages and map them
-//                        uint32 pages_allocated = 0;
-//                        struct FrameInfo *frame = NULL;
-//                        bool fail =0;
-//
-//                        for (uint32 page_va = va_to_find; page_va < va_to_find + need_pages * PAGE_SIZE; page_va += PAGE_SIZE) {
-//                            int ret = allocate_frame(&frame);
-//                            if (ret != 0 || frame == NULL) {
-//                                fail = 1;
-//                                panic("Failed to allocate frame\n");
-//                                break;
-//                            }
-//                            // map frame into page_va
-//                            uint32 permissions = PERM_PRESENT | PERM_WRITEABLE;
-//                            map_frame(ptr_page_directory, frame, page_va, permissions);
-//                            // ensure reverse map if map_frame didn't do it
-//                            frame_to_va[to_frame_number(frame)] = page_va & 0xFFFFF000;
-//                            pages_allocated++;
-//                        }
-////unsure if i have to do it or not !!!!!!! rollback or just panic!!!!!!
-//                        if (fail) {
-//                            // rollback allocated pages this attempt created
-//                            // free frames of allocated pages and unmap them
-//                            uint32 rollback_va = va_to_find;
-//                            for (uint32 i = 0; i < pages_allocated; ++i, rollback_va += PAGE_SIZE) {
-//                                // unmap and free frame
-//                               // unmap_frame(rollback_va);
-//                            }
-//                            // keep original allocation untouched
-//                            return virtual_address;
-//                        }
-//
-//                        // Success: we've mapped needed pages, now update metadata
-//                        // Reduce the free element's size and/or remove it
-//                        element->va += need_pages * PAGE_SIZE;
-//                        element->size -= need_pages * PAGE_SIZE;
-//                        if (element->size == 0) {
-//                            LIST_REMOVE(&kheap_list, element);
-//                        }
-//
-//                        // Update allocated metadata for this VA
-//                        kheapMetadata *alloc_meta = NULL;
-//                        LIST_FOREACH_SAFE(alloc_meta, &kheap_allocated_list, kheapMetadata) {
-//                            if (alloc_meta->va == va) {
-//                                alloc_meta->size = new_pages * PAGE_SIZE; // page-aligned size stored
-//                                break;//<<<<<<<<<<---------------------------see this again-----------------------------------------
-//                            }
-//                        }
-//                        // update size map
-//
-//                        return virtual_address;
-//                    }
-//                    // not enough contiguous pages in this free element: break (can't grow in-place here)
-//                    break;
-//                }
-//            }
-//            //allocate new b2a cuz there is no contigous va
-//
-//            // if we reached here: in-place extension not possible: fallback allocate new and free old
-//            void *n = kmalloc(new_size);
-//            if (!n) return virtual_address; // preserve old on failure
-//            kfree(virtual_address);
-//            return n;
-//        }
-//    }
-//
-//    // fallback: return original if nothing matched
-//    return virtual_address;
-//}
-
-/*
+// Resize a page-allocator allocation, never copying its contents:
+//  - shrink: unmap the tail pages and give them back
+//  - grow: in place into the free extent (or the break) right after it, otherwise move
+//    its frames to a new place by rewriting the PTEs and map only the extra pages there
+static void* krealloc_pages(kheapMetadata *node, uint32 new_size)
+{
+    uint32 va = node->va;
+    uint32 old_size = node->size;
+
+    if (new_size == old_size)
+        return (void*)va;
+
+    if (new_size < old_size) {
+        kheapMetadata *tail = find_available_node();
+        if (tail == NULL)
+            return (void*)va;   // still valid, just not shrunk
+        node->size = new_size;
+        tail->va = va + new_size;
+        tail->size = old_size - new_size;
+        kheap_release_pages(tail);
+        return (void*)va;
+    }
+
+    uint32 extra = new_size - old_size;
+    uint32 end = va + old_size;
+
+    // Grow in place into the adjacent free extent
+    kheapMetadata *next = kh_first_fit(kh_root[KH_ADDR_TREE], end, 1);
+    if (next != NULL && next->va == end && next->size >= extra) {
+        if (allocate_and_map_frames(ptr_page_directory, end, extra / PAGE_SIZE, KHEAP_PAGE_PERMS) != 0)
+            return NULL;
+        if (next->size == extra) {
+            remove_free_region(next);
+            release_node(next);
+        } else {
+            resize_free_region(next, next->va + extra, next->size - extra);
+        }
+        node->size = new_size;
+        return (void*)va;
+    }
+
+    // Grow in place by extending the break
+    if (end == kheapPageAllocBreak && extra <= KERNEL_HEAP_MAX - kheapPageAllocBreak) {
+        if (allocate_and_map_frames(ptr_page_directory, end, extra / PAGE_SIZE, KHEAP_PAGE_PERMS) != 0)
+            return NULL;
+        kheapPageAllocBreak += extra;
+        node->size = new_size;
+        return (void*)va;
+    }
+
+    // Move: only the extra pages get new frames
+    kheapMetadata *new_node = kheap_place_pages(new_size, old_size);
+    if (new_node == NULL)
+        return NULL;
+    kheap_move_pages(va, new_node->va, old_size);
+    kheap_untrack_pages(node);
+    kheap_release_pages(node);
+    return (void*)new_node->va;
+}
 
 void *krealloc(void *virtual_address, uint32 new_size)
 {
-    // TODO: Implement krealloc
-	if(virtual_address==NULL){
-		virtual_address=kmalloc(new_size);
-		return virtual_address;
-	}
-	if(new_size==0){
-		kfree(virtual_address);
-		return NULL;
-	}
-	int old_size=find_va_size[(uint32)virtual_address];
-	if(new_size==old_size)return virtual_address;
-
-		if((old_size<=DYN_ALLOC_MAX_SIZE&&new_size>DYN_ALLOC_MAX_SIZE)||(old_size>DYN_ALLOC_MAX_SIZE&&new_size<DYN_ALLOC_MAX_SIZE)){
-		//if block-->page
-	    //if page-->block
-			kfree(virtual_address);
-			return kmalloc(new_size);
-		}
-		//stretching
-			if(new_size>old_size){
-			if(new_size>DYN_ALLOC_MAX_SIZE){
-				//PAGE
-				kheapMetadata *element;
-                kheapMetadata *free_node=NULL;
-				//see if it can be strectched list
-				LIST_FOREACH_SAFE(element, &kheap_list, kheapMetadata) {
-				 if (element->va ==(uint32) virtual_address+old_size) {
-				   if(element->size>=new_size-old_size){//so its valid
-					   uint32 new_va=(uint32)virtual_address+old_size;
-					   uint32 size_to_allocate= ROUNDUP(new_size-old_size, PAGE_SIZE);
-					   for (uint32 va =new_va;
-					 va < (uint32) new_va+size_to_allocate;
-					 va += PAGE_SIZE) {
-					struct FrameInfo *frame;
-					int ret = allocate_frame(&frame);
-				if (ret != 0) {
-				panic("Failed to allocate frame\n");
-				}
-
-			if (frame == NULL) {
-		release_kspinlock(&kheap_spinlock);
-			return NULL;
-				}
-			uint32 permissions = PERM_PRESENT | PERM_WRITEABLE;
-			map_frame(ptr_page_directory, frame, va, permissions);
-			frame_to_va[to_frame_number(frame)] = va;
-		    LIST_REMOVE(&kheap_list, element);// remove it
-		    LIST_FOREACH_SAFE(element, &kheap_allocated_list, kheapMetadata) {
-				   }
-		           if(element->va==(uint32)virtual_address){
-		        	   element->size=element->size+size_to_allocate;
-		        	   break;
-		           }
-					   }
-				   }
-				  break;
-				 }
-				 return virtual_address;
-				 //it must be put somewhere else
-				 else{
-				kfree(virtual_address);
-			 return kmalloc(size_to_allocate+old_size);
-			}
-				}
-			}
-			else{
-				//BLOCK
-				//later
-			}
-
-	}
-
-    return NULL;
-    //panic("krealloc() is not implemented yet...!!");
-}
-*/
+    // handle trivial cases: NULL and zero-size
+    if (virtual_address == NULL) {
+        return kmalloc(new_size);
+    }
+    if (new_size == 0) {
+        kfree(virtual_address);
+        return NULL;
+    }
+
+    uint32 va = (uint32)virtual_address;
+    void *result;
+
+    acquire_kspinlock(&kheap_spinlock);
+    if (kheap_is_block_va(va)) {
+        // block -> block
+        if (new_size <= DYN_ALLOC_MAX_BLOCK_SIZE) {
+            result = realloc_block(virtual_address, new_size);
+            release_kspinlock(&kheap_spinlock);
+            return result;
+        }
+        // block -> page
+        uint32 old_size = get_block_size(virtual_address);
+        release_kspinlock(&kheap_spinlock);
+        result = kmalloc(new_size);
+        if (result != NULL) {
+            memcpy(result, virtual_address, old_size);
+            kfree(virtual_address);
+        }
+        return result;
+    }
+
+    kheapMetadata *node = kheap_va_lookup(va);
+    if (node == NULL) {
+        panic("krealloc: %x is not an allocated address!", va);
+    }
+    // page -> page
+    if (new_size > DYN_ALLOC_MAX_BLOCK_SIZE) {
+        result = krealloc_pages(node, ROUNDUP(new_size, PAGE_SIZE));
+        release_kspinlock(&kheap_spinlock);
+        return result;
+    }
+    // page -> block
+    release_kspinlock(&kheap_spinlock);
+    result = kmalloc(new_size);
+    if (result != NULL) {
+        memcpy(result, virtual_address, new_size);
+        kfree(virtual_address);
+    }
+    return result;
+}
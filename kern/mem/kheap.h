@@ -20,6 +20,10 @@ typedef struct kheapMetadata {
     unsigned int size;
     bool is_used;// Total Block Size (The Value
     LIST_ENTRY(kheapMetadata) prev_next_info;
+    // Free-extent index links ([0] by address, [1] by size): see kheap.c
+    struct kheapMetadata *tree_left[2];
+    struct kheapMetadata *tree_right[2];
+    unsigned int max_size;                       // Largest size in the address subtree
 } kheapMetadata;
 // List head declarations
 LIST_HEAD(kmalloc_linkedlist, kheapMetadata);
@@ -56,6 +60,22 @@ extern struct kMetadata_free_list kheap_metadata_free_list;
 // Statistics
  int numOfKheapVACalls;
 
+// Per-CPU block magazines (see kheap.c)
+#define KHEAP_MAG_CAPACITY  16     // max ready blocks per size class per CPU
+#define KHEAP_MAG_BATCH     8      // blocks moved per refill/drain
+struct kheapMagazineStats
+{
+    uint32 alloc_hits, alloc_misses;
+    uint32 free_hits, free_misses;
+};
+void kheap_magazine_stats(struct kheapMagazineStats *total);
+void kheap_magazines_drain(void);     // all CPUs: quiescent callers only
+
+// Metadata node pool accounting (capacity = MAX_KHEAP_PAGES_COUNT nodes)
+ uint32 kheapNodesInUse;
+ uint32 kheapNodesPeakInUse;
+ uint32 kheapNodesExhausted;     // # of node requests that found the pool empty
+
 //==================================================================================//
 //============================== STRATEGY SETTERS/GETTERS ==========================//
 //==================================================================================//
@@ -80,5 +100,6 @@ void kfree(void* virtual_address);
 void* krealloc(void* virtual_address, unsigned int new_size);
 unsigned int kheap_virtual_address(unsigned int physical_address);
 unsigned int kheap_physical_address(unsigned int virtual_address);
+void* kheap_reserve_pages(unsigned int size);
 
 #endif // FOS_KERN_KHEAP_H_
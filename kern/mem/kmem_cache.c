@@ -0,0 +1,148 @@
+#include "kmem_cache.h"
+
+#include <inc/memlayout.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+#include <inc/stdio.h>
+#include "kheap.h"
+
+//==================================================================================//
+//============================== GLOBAL VARIABLES ==================================//
+//==================================================================================//
+
+// Cache descriptors are created once and live for the whole kernel lifetime
+static struct kmem_cache kmem_caches[KMEM_CACHE_MAX_CACHES];
+static uint32 kmem_num_caches = 0;
+static struct kspinlock kmem_caches_lock;
+
+// The free link of an object is kept in the word that follows it, so that freeing
+// an object never overwrites its constructed state
+#define KMEM_FREE_LINK(cache, obj) (*(void**)((char*)(obj) + (cache)->obj_stride - sizeof(void*)))
+
+//==================================================================================//
+//============================== HELPER FUNCTIONS ==================================//
+//==================================================================================//
+
+// Carve a new page-sized slab into constructed objects and push them on the free stack.
+// Called with cache->lock held. Return 0 if the kernel heap is out of memory.
+static int kmem_cache_grow(struct kmem_cache *cache)
+{
+	char *slab = kmalloc(PAGE_SIZE);
+	if (slab == NULL)
+		return 0;
+	for (int i = cache->objs_per_slab - 1; i >= 0; i--)
+	{
+		void *obj = slab + i * cache->obj_stride;
+		if (cache->ctor != NULL)
+			cache->ctor(obj);
+		KMEM_FREE_LINK(cache, obj) = cache->free_objs;
+		cache->free_objs = obj;
+	}
+	cache->num_slabs++;
+	cache->num_objs += cache->objs_per_slab;
+	cache->num_free += cache->objs_per_slab;
+	cache->num_grows++;
+	return 1;
+}
+
+//==================================================================================//
+//============================ REQUIRED FUNCTIONS ==================================//
+//==================================================================================//
+
+//==============================
+// [1] INITIALIZE OBJECT CACHES:
+//==============================
+void kmem_cache_init(void)
+{
+	init_kspinlock(&kmem_caches_lock, "kmem caches lock");
+	kmem_num_caches = 0;
+}
+
+//==============================
+// [2] CREATE A NEW OBJECT CACHE:
+//==============================
+//Objects must fit (with their free link) in a single page.
+//Panic if the cache table is full
+struct kmem_cache* kmem_cache_create(char *name, uint32 obj_size, void (*ctor)(void *obj))
+{
+	assert(obj_size > 0 && obj_size + sizeof(void*) <= PAGE_SIZE);
+
+	acquire_kspinlock(&kmem_caches_lock);
+	if (kmem_num_caches == KMEM_CACHE_MAX_CACHES)
+		panic("kmem_cache_create: can't create cache [%s], cache table is full", name);
+	struct kmem_cache *cache = &kmem_caches[kmem_num_caches++];
+	release_kspinlock(&kmem_caches_lock);
+
+	memset(cache, 0, sizeof(struct kmem_cache));
+	strncpy(cache->name, name, KMEM_CACHE_NAME_LEN - 1);
+	cache->obj_size = obj_size;
+	cache->obj_stride = ROUNDUP(obj_size, sizeof(void*)) + sizeof(void*);
+	cache->objs_per_slab = PAGE_SIZE / cache->obj_stride;
+	cache->ctor = ctor;
+	cache->free_objs = NULL;
+	init_kspinlock(&cache->lock, cache->name);
+	return cache;
+}
+
+//==============================
+// [3] ALLOCATE AN OBJECT:
+//==============================
+//Pop a constructed object in O(1), carving a new slab only when the cache is empty.
+//Return NULL if the kernel heap can't supply a new slab
+void* kmem_cache_alloc(struct kmem_cache *cache)
+{
+	bool lck = 0;
+	if (!holding_kspinlock(&cache->lock))
+	{
+		acquire_kspinlock(&cache->lock);
+		lck = 1;
+	}
+	void *obj = NULL;
+	if (cache->free_objs != NULL || kmem_cache_grow(cache))
+	{
+		obj = cache->free_objs;
+		cache->free_objs = KMEM_FREE_LINK(cache, obj);
+		cache->num_free--;
+		cache->num_allocs++;
+	}
+	if (lck)
+		release_kspinlock(&cache->lock);
+	return obj;
+}
+
+//==============================
+// [4] FREE AN OBJECT:
+//==============================
+//Push the object back on the cache in O(1). It stays warm for the next allocation
+void kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+	if (obj == NULL)
+		return;
+	bool lck = 0;
+	if (!holding_kspinlock(&cache->lock))
+	{
+		acquire_kspinlock(&cache->lock);
+		lck = 1;
+	}
+	KMEM_FREE_LINK(cache, obj) = cache->free_objs;
+	cache->free_objs = obj;
+	cache->num_free++;
+	if (lck)
+		release_kspinlock(&cache->lock);
+}
+
+//==============================
+// [5] PRINT CACHE STATISTICS:
+//==============================
+void kmem_cache_print_stats(void)
+{
+	cprintf("Object caches:\n");
+	for (int i = 0; i < kmem_num_caches; i++)
+	{
+		struct kmem_cache *cache = &kmem_caches[i];
+		cprintf("	%s: obj size = %d, slabs = %d, objs in use = %d/%d, allocs = %d, grows = %d\n",
+				cache->name, cache->obj_size, cache->num_slabs,
+				cache->num_objs - cache->num_free, cache->num_objs,
+				cache->num_allocs, cache->num_grows);
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef FOS_KERN_KMEM_CACHE_H_
+#define FOS_KERN_KMEM_CACHE_H_
+
+#ifndef FOS_KERNEL
+# error "This is a FOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/queue.h>
+#include "../conc/kspinlock.h"
+
+//==================================================================================//
+//============================== TYPED OBJECT CACHES ===============================//
+//==================================================================================//
+// A cache hands out fixed-size objects carved from whole kernel-heap pages (slabs).
+// Objects are constructed once, when their slab is carved, and must be handed back
+// to kmem_cache_free() in their constructed state. Freed objects stay in the cache
+// (warm) and are reused LIFO; slabs are never returned to the kernel heap.
+
+#define KMEM_CACHE_MAX_CACHES	16
+#define KMEM_CACHE_NAME_LEN		24
+
+struct kmem_cache
+{
+	char name[KMEM_CACHE_NAME_LEN];
+	uint32 obj_size;				// size requested by the creator
+	uint32 obj_stride;				// obj_size rounded up + free-link word
+	uint32 objs_per_slab;
+	void (*ctor)(void *obj);		// optional: called once per object when its slab is carved
+
+	void *free_objs;				// LIFO stack of free objects (linked after each object)
+	uint32 num_slabs;
+	uint32 num_objs;
+	uint32 num_free;
+
+	// statistics
+	uint32 num_allocs;
+	uint32 num_grows;
+
+	struct kspinlock lock;
+};
+
+void kmem_cache_init(void);
+struct kmem_cache* kmem_cache_create(char *name, uint32 obj_size, void (*ctor)(void *obj));
+void* kmem_cache_alloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+void kmem_cache_print_stats(void);
+
+#endif // FOS_KERN_KMEM_CACHE_H_
@@ -33,11 +33,68 @@ void tlb_invalidate(uint32 *ptr_page_directory, void *virtual_address)
 {
 	// Flush the entry only if we're modifying the current address space.
 	/*2025*/ //check is added
+	// Kernel pages are shared by all address spaces and are global (survive CR3 reloads),
+	// so they're always flushed.
 	struct Env* e = get_cpu_proc();
-	if (!e || e->env_page_directory == ptr_page_directory)
+	if (!e || e->env_page_directory == ptr_page_directory || CHECK_IF_KERNEL_ADDRESS(virtual_address))
 		invlpg(virtual_address);
 }
 
+//
+// Invalidate the TLB entries of the pages of [virtual_address, +size) if they belong to the current
+// address space: one invlpg per page, or a full flush (CR3 reload) for a user range of more than
+// TLB_INVLPG_MAX_PAGES pages. Kernel ranges are always invalidated page by page, since they're
+// shared by all address spaces and a CR3 reload doesn't drop their (global) entries.
+//
+void tlb_invalidate_range(uint32 *ptr_page_directory, uint32 virtual_address, uint32 size)
+{
+	struct Env* e = get_cpu_proc();
+	if (e && e->env_page_directory != ptr_page_directory && !CHECK_IF_KERNEL_ADDRESS(virtual_address))
+		return;
+	uint32 start = ROUNDDOWN(virtual_address, PAGE_SIZE);
+	uint32 num_of_pages = ROUNDUP(size + (virtual_address - start), PAGE_SIZE) / PAGE_SIZE;
+	if (num_of_pages > TLB_INVLPG_MAX_PAGES && start < USER_TOP)
+	{
+		tlbflush();
+		return;
+	}
+	for (uint32 i = 0; i < num_of_pages; i++)
+		invlpg((void*)(start + i * PAGE_SIZE));
+}
+
+//
+// The page table 'ptr_page_table' (a kernel VA) of the PDE of 'virtual_address' was unlinked from
+// the directory: invalidate the TLB entries of its present pages and of its page in the VPT window,
+// if they belong to the current address space (a full flush if it has too many present pages).
+//
+void tlb_invalidate_page_table(uint32 *ptr_page_directory, uint32 virtual_address, uint32 *ptr_page_table)
+{
+	struct Env* e = get_cpu_proc();
+	if (e && e->env_page_directory != ptr_page_directory && !CHECK_IF_KERNEL_ADDRESS(virtual_address))
+		return;
+	uint32 table_va = ROUNDDOWN(virtual_address, PTSIZE);
+	uint32 num_of_present = 0;
+	for (int i = 0; i < NPTENTRIES; i++)
+	{
+		if (ptr_page_table[i] & PERM_PRESENT)
+			num_of_present++;
+	}
+	if (num_of_present > TLB_INVLPG_MAX_PAGES && table_va < USER_TOP)
+	{
+		tlbflush();
+		return;
+	}
+	for (int i = 0; i < NPTENTRIES && num_of_present > 0; i++)
+	{
+		if (ptr_page_table[i] & PERM_PRESENT)
+		{
+			invlpg((void*)(table_va + i * PAGE_SIZE));
+			num_of_present--;
+		}
+	}
+	invlpg(vpt_table(virtual_address));
+}
+
 ///******************************* MAPPING USER SPACE *******************************
 
 // --------------------------------------------------------------
@@ -46,13 +103,14 @@ void tlb_invalidate(uint32 *ptr_page_directory, void *virtual_address)
 // frames_info are reference counted, and free frames are kept on a linked list.
 // --------------------------------------------------------------
 
-// Initialize paging structure and free_frame_list.
+// Initialize paging structure and the free frames (buddy allocator).
 // After this point, ONLY use the functions below
 // to allocate and deallocate physical memory via the free_frame_list,
 // and NEVER use boot_allocate_space() or the related boot-time functions above.
 //
 
 extern void initialize_disk_page_file();
+static void buddy_free_block(struct FrameInfo *ptr_frame_info, uint32 order);
 void initialize_paging()
 {
 	// The example code here marks all frames_info as free.
@@ -71,6 +129,11 @@ void initialize_paging()
 	int i;
 	LIST_INIT(&MemFrameLists.free_frame_list);
 	LIST_INIT(&MemFrameLists.modified_frame_list);
+	MemFrameLists.num_free_buffered = 0;
+	LIST_INIT(&MemFrameLists.zeroed_frame_list);
+	for (i = 0; i <= BUDDY_MAX_ORDER; i++)
+		LIST_INIT(&MemFrameLists.buddy_free_area[i]);
+	MemFrameLists.buddy_num_free = 0;
 
 	//Initialize the corresponding lock
 	init_kspinlock(&MemFrameLists.mfllock, "Frame Info Lock");
@@ -95,7 +158,7 @@ void initialize_paging()
 		initialize_frame_info(&(frames_info[i]));
 		//frames_info[i].references = 0;
 
-		LIST_INSERT_HEAD(&MemFrameLists.free_frame_list, &frames_info[i]);
+		buddy_free_block(&frames_info[i], 0);
 	}
 
 	for (i = PHYS_IO_MEM/PAGE_SIZE ; i < PHYS_EXTENDED_MEM/PAGE_SIZE; i++)
@@ -115,7 +178,7 @@ void initialize_paging()
 		initialize_frame_info(&(frames_info[i]));
 
 		//frames_info[i].references = 0;
-		LIST_INSERT_HEAD(&MemFrameLists.free_frame_list, &frames_info[i]);
+		buddy_free_block(&frames_info[i], 0);
 	}
 
 	initialize_disk_page_file();
@@ -131,6 +194,194 @@ void initialize_frame_info(struct FrameInfo *ptr_frame_info)
 	memset(ptr_frame_info, 0, sizeof(*ptr_frame_info));
 }
 
+//
+// Buddy allocator of the clean free frames (orders 0..BUDDY_MAX_ORDER).
+// A free block of 2^order frames is aligned to its size and is represented by its first frame,
+// linked on MemFrameLists.buddy_free_area[order] with buddy_free = 1 and buddy_order = order.
+// The buddy of the block that starts at frame #fn is the one that starts at frame #(fn ^ 2^order).
+// All helpers must be called with MemFrameLists.mfllock held
+//
+// Give back a block of 2^order frames, merging it with its free buddies as far as possible
+static void buddy_free_block(struct FrameInfo *ptr_frame_info, uint32 order)
+{
+	uint32 fn = to_frame_number(ptr_frame_info);
+	MemFrameLists.buddy_num_free += (1 << order);
+	while (order < BUDDY_MAX_ORDER)
+	{
+		uint32 buddy_fn = fn ^ (1 << order);
+		if (buddy_fn >= number_of_frames)
+			break;
+		struct FrameInfo *ptr_buddy = &frames_info[buddy_fn];
+		if (!ptr_buddy->buddy_free || ptr_buddy->buddy_order != order)
+			break;
+		LIST_REMOVE(&MemFrameLists.buddy_free_area[order], ptr_buddy);
+		ptr_buddy->buddy_free = 0;
+		fn &= ~(1 << order);
+		order++;
+	}
+	struct FrameInfo *ptr_head = &frames_info[fn];
+	ptr_head->buddy_free = 1;
+	ptr_head->buddy_order = order;
+	LIST_INSERT_HEAD(&MemFrameLists.buddy_free_area[order], ptr_head);
+}
+
+// Take a block of 2^order frames from the smallest free order that has one, splitting it down.
+// Return NULL if there is none
+static struct FrameInfo* buddy_alloc_block(uint32 order)
+{
+	uint32 k = order;
+	while (k <= BUDDY_MAX_ORDER && LIST_SIZE(&MemFrameLists.buddy_free_area[k]) == 0)
+		k++;
+	if (k > BUDDY_MAX_ORDER)
+		return NULL;
+	struct FrameInfo *ptr_head = LIST_FIRST(&MemFrameLists.buddy_free_area[k]);
+	LIST_REMOVE(&MemFrameLists.buddy_free_area[k], ptr_head);
+	ptr_head->buddy_free = 0;
+	//keep the lower half, give back the upper half at each split
+	while (k > order)
+	{
+		k--;
+		struct FrameInfo *ptr_upper = ptr_head + (1 << k);
+		ptr_upper->buddy_free = 1;
+		ptr_upper->buddy_order = k;
+		LIST_INSERT_HEAD(&MemFrameLists.buddy_free_area[k], ptr_upper);
+	}
+	MemFrameLists.buddy_num_free -= (1 << order);
+	return ptr_head;
+}
+
+// Take one free frame (mfllock held): a clean order-0 frame of the buddies first, then a buffered
+// frame of free_frame_list (its page is lost), and the pre-zeroed frames as the last resort.
+// Return NULL if there is no free frame at all
+static struct FrameInfo* take_free_frame()
+{
+	struct FrameInfo *ptr_frame_info = buddy_alloc_block(0);
+
+	if (ptr_frame_info == NULL && (ptr_frame_info = LIST_FIRST(&MemFrameLists.free_frame_list)) != NULL)
+	{
+		LIST_REMOVE(&MemFrameLists.free_frame_list, ptr_frame_info);
+
+		/******************* PAGE BUFFERING CODE *******************
+		 ***********************************************************/
+
+		if(ptr_frame_info->isBuffered)
+		{
+			MemFrameLists.num_free_buffered--;
+			/*MUST UN-COMMENT THIS LINE*/
+			pt_clear_page_table_entry(ptr_frame_info->proc->env_page_directory,ptr_frame_info->va);
+		}
+
+		/**********************************************************
+		 ***********************************************************/
+	}
+
+	if (ptr_frame_info == NULL && (ptr_frame_info = LIST_FIRST(&MemFrameLists.zeroed_frame_list)) != NULL)
+		LIST_REMOVE(&MemFrameLists.zeroed_frame_list, ptr_frame_info);
+
+	if (ptr_frame_info != NULL)
+		initialize_frame_info(ptr_frame_info);
+	return ptr_frame_info;
+}
+
+// # free frames that allocate_frame() can still return on this CPU (mfllock held)
+uint32 count_free_frames()
+{
+	return MemFrameLists.buddy_num_free + LIST_SIZE(&MemFrameLists.free_frame_list) +
+			LIST_SIZE(&MemFrameLists.zeroed_frame_list) + mycpu()->num_hot_frames;
+}
+
+//
+// Allocates 2^order physically contiguous frames (order <= BUDDY_MAX_ORDER), aligned to their
+// total size. The Frame_Info of the others follow the returned one in frames_info.
+// Does NOT set their contents to zero, and references are not incremented.
+//
+// RETURNS
+//   the Frame_Info of the first frame -- on success
+//   NULL -- if no free block of this order can be formed
+//
+struct FrameInfo* allocate_contiguous_frames(uint32 order)
+{
+	if (order > BUDDY_MAX_ORDER)
+		return NULL;
+	bool lock_already_held = holding_kspinlock(&MemFrameLists.mfllock);
+	if (!lock_already_held)
+	{
+		acquire_kspinlock(&MemFrameLists.mfllock);
+	}
+	struct FrameInfo *ptr_head = buddy_alloc_block(order);
+	if (ptr_head == NULL && order > 0)
+	{
+		//give the hot frames of this CPU and the pre-zeroed frames back to the buddies, then retry
+		struct FrameInfo *ptr_frame_info;
+		hot_frames_drain(mycpu(), 0);
+		while ((ptr_frame_info = LIST_FIRST(&MemFrameLists.zeroed_frame_list)) != NULL)
+		{
+			LIST_REMOVE(&MemFrameLists.zeroed_frame_list, ptr_frame_info);
+			buddy_free_block(ptr_frame_info, 0);
+		}
+		ptr_head = buddy_alloc_block(order);
+	}
+	if (ptr_head != NULL)
+	{
+		for (uint32 i = 0; i < (1 << order); i++)
+			initialize_frame_info(ptr_head + i);
+	}
+	if (!lock_already_held)
+	{
+		release_kspinlock(&MemFrameLists.mfllock);
+	}
+	return ptr_head;
+}
+
+//
+// Return a block allocated by allocate_contiguous_frames() with the same order.
+// (Its frames should have no more references.)
+//
+void free_contiguous_frames(struct FrameInfo *ptr_frame_info, uint32 order)
+{
+	assert(order <= BUDDY_MAX_ORDER && to_frame_number(ptr_frame_info) % (1 << order) == 0);
+	bool lock_already_held = holding_kspinlock(&MemFrameLists.mfllock);
+	if (!lock_already_held)
+	{
+		acquire_kspinlock(&MemFrameLists.mfllock);
+	}
+	for (uint32 i = 0; i < (1 << order); i++)
+		initialize_frame_info(ptr_frame_info + i);
+	buddy_free_block(ptr_frame_info, order);
+	if (!lock_already_held)
+	{
+		release_kspinlock(&MemFrameLists.mfllock);
+	}
+}
+
+//
+// Per-CPU hot frames (struct cpu): both helpers must be called with MemFrameLists.mfllock held
+//
+// Move up to CPU_HOT_FRAMES_BATCH clean order-0 frames from the buddies to the hot frames of the
+// given CPU. Buffered frames are never cached: they keep their page until they are really allocated
+void hot_frames_refill(struct cpu *c)
+{
+	struct FrameInfo *ptr_frame_info;
+	while (c->num_hot_frames < CPU_HOT_FRAMES_BATCH &&
+			(ptr_frame_info = buddy_alloc_block(0)) != NULL)
+	{
+		initialize_frame_info(ptr_frame_info);
+		c->hot_frames[c->num_hot_frames++] = ptr_frame_info;
+	}
+}
+
+// Give the coldest hot frames of the given CPU back to the buddies until only 'keep' remain
+void hot_frames_drain(struct cpu *c, uint32 keep)
+{
+	if (c->num_hot_frames <= keep)
+		return;
+	uint32 num_to_drain = c->num_hot_frames - keep;
+	for (uint32 i = 0; i < num_to_drain; i++)
+		buddy_free_block(c->hot_frames[i], 0);
+	memmove(&c->hot_frames[0], &c->hot_frames[num_to_drain], keep * sizeof(struct FrameInfo*));
+	c->num_hot_frames = keep;
+}
+
 //
 // Allocates a physical frame.
 // Does NOT set the contents of the physical frame to zero -
@@ -147,6 +398,19 @@ void initialize_frame_info(struct FrameInfo *ptr_frame_info)
 // Hint: references should not be incremented
 int allocate_frame(struct FrameInfo **ptr_frame_info)
 {
+	//Fast path: pop a hot frame of this CPU without the frames lock (cached frames are already clean)
+	pushcli();
+	{
+		struct cpu *c = mycpu();
+		if (c->num_hot_frames > 0)
+		{
+			*ptr_frame_info = c->hot_frames[--c->num_hot_frames];
+			popcli();
+			return 0;
+		}
+	}
+	popcli();
+
 	bool lock_already_held = holding_kspinlock(&MemFrameLists.mfllock);
 
 	if (!lock_already_held)
@@ -154,29 +418,15 @@ int allocate_frame(struct FrameInfo **ptr_frame_info)
 		acquire_kspinlock(&MemFrameLists.mfllock);
 	}
 
-	*ptr_frame_info = LIST_FIRST(&MemFrameLists.free_frame_list);
-	int c = 0;
+	*ptr_frame_info = take_free_frame();
 
 	if (*ptr_frame_info == NULL)
 	{
 		panic("ERROR: Kernel run out of memory... allocate_frame cannot find a free frame.\n");
 	}
 
-	LIST_REMOVE(&MemFrameLists.free_frame_list,*ptr_frame_info);
-
-	/******************* PAGE BUFFERING CODE *******************
-	 ***********************************************************/
-
-	if((*ptr_frame_info)->isBuffered)
-	{
-		/*MUST UN-COMMENT THIS LINE*/
-		//pt_clear_page_table_entry((*ptr_frame_info)->proc->env_page_directory,(*ptr_frame_info)->va);
-	}
-
-	/**********************************************************
-	 ***********************************************************/
-
-	initialize_frame_info(*ptr_frame_info);
+	//refill the hot frames of this CPU by a batch (interrupts are off while the lock is held)
+	hot_frames_refill(mycpu());
 
 	if (!lock_already_held)
 	{
@@ -187,11 +437,28 @@ int allocate_frame(struct FrameInfo **ptr_frame_info)
 }
 
 //
-// Return a frame to the free_frame_list.
+// Return a frame to the free frames (through the hot frames of this CPU).
 // (This function should only be called when ptr_frame_info->references reaches 0.)
 //
 void free_frame(struct FrameInfo *ptr_frame_info)
 {
+	/*2012: clear it to ensure that its members (env, isBuffered, ...) become NULL*/
+	initialize_frame_info(ptr_frame_info);
+	/*=============================================================================*/
+
+	//Fast path: keep it (cache-warm) on top of the hot frames of this CPU without the frames lock
+	pushcli();
+	{
+		struct cpu *c = mycpu();
+		if (c->num_hot_frames < CPU_HOT_FRAMES_MAX)
+		{
+			c->hot_frames[c->num_hot_frames++] = ptr_frame_info;
+			popcli();
+			return;
+		}
+	}
+	popcli();
+
 	bool lock_already_held = holding_kspinlock(&MemFrameLists.mfllock);
 
 	if (!lock_already_held)
@@ -199,11 +466,10 @@ void free_frame(struct FrameInfo *ptr_frame_info)
 		acquire_kspinlock(&MemFrameLists.mfllock);
 	}
 	{
-		/*2012: clear it to ensure that its members (env, isBuffered, ...) become NULL*/
-		initialize_frame_info(ptr_frame_info);
-		/*=============================================================================*/
-		// Fill this function in
-		LIST_INSERT_HEAD(&MemFrameLists.free_frame_list, ptr_frame_info);
+		//drain the coldest batch of this CPU back to the list and keep the freed frame hot
+		struct cpu *c = mycpu();
+		hot_frames_drain(c, CPU_HOT_FRAMES_MAX - CPU_HOT_FRAMES_BATCH);
+		c->hot_frames[c->num_hot_frames++] = ptr_frame_info;
 		//LOG_STATMENT(cprintf("FN # %d FREED",to_frame_number(ptr_frame_info)));
 	}
 	if (!lock_already_held)
@@ -212,6 +478,143 @@ void free_frame(struct FrameInfo *ptr_frame_info)
 	}
 }
 
+//
+// Pre-zeroed frames pool
+//
+// With the kernel heap, physical frames aren't mapped in the kernel: each CPU reaches a frame
+// through its own scratch page of the kernel heap by pointing the scratch PTE to it
+static uint32 frame_scratch_va = 0;
+
+void zeroed_frames_pool_init()
+{
+#if USE_KHEAP
+	frame_scratch_va = (uint32)kheap_reserve_pages(NCPUS * PAGE_SIZE);
+	if (frame_scratch_va == 0)
+		panic("zeroed_frames_pool_init: can't reserve the scratch pages in the kernel heap");
+#endif
+}
+
+#if USE_KHEAP
+// Map the frame at the scratch page of this CPU (interrupts must stay off till it's unmapped)
+static inline void* map_scratch_page(struct FrameInfo *ptr_frame_info)
+{
+	uint32 scratch_va = frame_scratch_va + (mycpu() - CPUS) * PAGE_SIZE;
+	*vpt_entry(scratch_va) = CONSTRUCT_ENTRY(to_physical_address(ptr_frame_info), PERM_PRESENT | PERM_WRITEABLE);
+	invlpg((void*)scratch_va);
+	return (void*)scratch_va;
+}
+
+static inline void unmap_scratch_page(void *scratch_va)
+{
+	*vpt_entry((uint32)scratch_va) = 0;
+	invlpg(scratch_va);
+}
+#endif
+
+static void zero_frame(struct FrameInfo *ptr_frame_info)
+{
+#if USE_KHEAP
+	pushcli();
+	{
+		void *scratch_va = map_scratch_page(ptr_frame_info);
+		memset(scratch_va, 0, PAGE_SIZE);
+		unmap_scratch_page(scratch_va);
+	}
+	popcli();
+#else
+	memset(STATIC_KERNEL_VIRTUAL_ADDRESS(to_physical_address(ptr_frame_info)), 0, PAGE_SIZE);
+#endif
+}
+
+//
+// Copy the content of the given frame to 'dst' (a kernel VA), e.g. to write back a frame that
+// isn't mapped in the loaded directory
+//
+void read_frame(struct FrameInfo *ptr_frame_info, void *dst)
+{
+#if USE_KHEAP
+	pushcli();
+	{
+		void *scratch_va = map_scratch_page(ptr_frame_info);
+		memcpy(dst, scratch_va, PAGE_SIZE);
+		unmap_scratch_page(scratch_va);
+	}
+	popcli();
+#else
+	memcpy(dst, STATIC_KERNEL_VIRTUAL_ADDRESS(to_physical_address(ptr_frame_info)), PAGE_SIZE);
+#endif
+}
+
+//
+// Allocates a physical frame filled by zeros: from the pre-zeroed pool if it has stock,
+// else a normal frame is zeroed now.
+//
+// RETURNS
+//   0 -- on success
+//   If failed, it panic (as allocate_frame()).
+//
+int allocate_zeroed_frame(struct FrameInfo **ptr_frame_info)
+{
+	bool lock_already_held = holding_kspinlock(&MemFrameLists.mfllock);
+	if (!lock_already_held)
+	{
+		acquire_kspinlock(&MemFrameLists.mfllock);
+	}
+	*ptr_frame_info = LIST_FIRST(&MemFrameLists.zeroed_frame_list);
+	if (*ptr_frame_info != NULL)
+	{
+		LIST_REMOVE(&MemFrameLists.zeroed_frame_list, *ptr_frame_info);
+		zeroedPoolHits++;
+	}
+	else
+		zeroedPoolMisses++;
+	if (!lock_already_held)
+	{
+		release_kspinlock(&MemFrameLists.mfllock);
+	}
+	if (*ptr_frame_info != NULL)
+		return 0;
+
+	int ret = allocate_frame(ptr_frame_info);
+	if (ret != 0)
+		return ret;
+	zero_frame(*ptr_frame_info);
+	return 0;
+}
+
+//
+// Zero up to 'max_frames' free frames into the pool. Called by the scheduler when it has nothing
+// ready to run. Stops once the pool is full or the memory becomes scarce.
+//
+void zeroed_frames_pool_refill(uint32 max_frames)
+{
+	if (USE_KHEAP && frame_scratch_va == 0)
+		return;
+	for (uint32 i = 0; i < max_frames; i++)
+	{
+		struct FrameInfo *ptr_frame_info = NULL;
+		acquire_kspinlock(&MemFrameLists.mfllock);
+		{
+			if (LIST_SIZE(&MemFrameLists.zeroed_frame_list) < ZEROED_FRAMES_POOL_SIZE &&
+					MemFrameLists.buddy_num_free + mycpu()->num_hot_frames > 0 &&
+					!is_memory_scarce())
+				allocate_frame(&ptr_frame_info);
+		}
+		release_kspinlock(&MemFrameLists.mfllock);
+		if (ptr_frame_info == NULL)
+			return;
+
+		//zero it outside the lock, then publish it
+		zero_frame(ptr_frame_info);
+
+		acquire_kspinlock(&MemFrameLists.mfllock);
+		{
+			LIST_INSERT_HEAD(&MemFrameLists.zeroed_frame_list, ptr_frame_info);
+		}
+		release_kspinlock(&MemFrameLists.mfllock);
+	}
+}
+
 //
 // Decrement the reference count on a frame
 // freeing it if there are no more references.
@@ -222,6 +625,15 @@ void decrement_references(struct FrameInfo* ptr_frame_info)
 		free_frame(ptr_frame_info);
 }
 
+// Kernel VA of the (present) user page table of the given PDE: reached through the VPT window
+// if the directory is the loaded one, else translated back from its frame
+static inline uint32* user_page_table(uint32 *ptr_page_directory, uint32 virtual_address, uint32 page_directory_entry)
+{
+	if (is_loaded_directory(ptr_page_directory))
+		return vpt_table(virtual_address);
+	return (uint32 *)kheap_virtual_address(EXTRACT_ADDRESS(page_directory_entry));
+}
+
 //
 // Stores address of page table entry in *ptr_page_table .
 // Stores 0 if there is no such entry or on error.
@@ -242,7 +654,7 @@ int get_page_table(uint32 *ptr_page_directory, const uint32 virtual_address, uin
 		//	cprintf("gpt .07, page_directory_entry= %x \n",page_directory_entry);
 		if(USE_KHEAP && !CHECK_IF_KERNEL_ADDRESS(virtual_address))
 		{
-			*ptr_page_table = (void *)kheap_virtual_address(EXTRACT_ADDRESS(page_directory_entry)) ;
+			*ptr_page_table = user_page_table(ptr_page_directory, virtual_address, page_directory_entry) ;
 			//cprintf("===>get_page_table: page_dir_entry = %x ptr_page_table = %x\n", page_directory_entry,*ptr_page_table);
 		}
 		else
@@ -267,7 +679,7 @@ int get_page_table(uint32 *ptr_page_directory, const uint32 virtual_address, uin
 		page_directory_entry = ptr_page_directory[PDX(virtual_address)];
 		if(USE_KHEAP && !CHECK_IF_KERNEL_ADDRESS(virtual_address))
 		{
-			*ptr_page_table = (void *)kheap_virtual_address(EXTRACT_ADDRESS(page_directory_entry)) ;
+			*ptr_page_table = user_page_table(ptr_page_directory, virtual_address, page_directory_entry) ;
 		}
 		else
 		{
@@ -294,7 +706,8 @@ void * create_page_table(uint32 *ptr_directory, const uint32 virtual_address)
 	//link it to the given directory and return the address of the created table
 	//REMEMBER TO:
 	//	a.	clear all entries (as it may contain garbage data)
-	//	b.	clear the TLB cache (using "tlbflush()")
+	//	b.	invalidate the TLB entry of the new table in the VPT window (a non-present PDE has no
+	//		cached translations, so there is nothing else to flush)
 
 	//change this "return" according to your answer
 
@@ -312,7 +725,7 @@ void * create_page_table(uint32 *ptr_directory, const uint32 virtual_address)
 
 	//================
 	memset(ptr_page_table , 0, PAGE_SIZE);
-	tlbflush();
+	tlb_invalidate(ptr_directory, vpt_table(virtual_address));
 
 #else
 	uint32 * ptr_page_table ;
@@ -335,7 +748,7 @@ void __static_cpt(uint32 *ptr_directory, const uint32 virtual_address, uint32 **
 	ptr_directory[PDX(virtual_address)] = CONSTRUCT_ENTRY(phys_page_table, PERM_PRESENT | PERM_USER | PERM_WRITEABLE);
 	//initialize new page table by 0's
 	memset(*ptr_page_table , 0, PAGE_SIZE);
-	tlbflush();
+	tlb_invalidate(ptr_directory, vpt_table(virtual_address));
 }
 //
 // Map the physical frame 'ptr_frame_info' at 'virtual_address'.
@@ -358,8 +771,6 @@ int map_frame(uint32 *ptr_page_directory, struct FrameInfo *ptr_frame_info, uint
 	// Fill this function in
 	uint32 physical_address = to_physical_address(ptr_frame_info);
 	uint32 *ptr_page_table;
-	uint32 frame_num = to_frame_number(ptr_frame_info);
-	frame_to_va[frame_num] = virtual_address & 0xFFFFF000;
 	if( get_page_table(ptr_page_directory, virtual_address, &ptr_page_table) == TABLE_NOT_EXIST)
 	{
 		/*==========================================================================================
@@ -427,9 +838,88 @@ int map_frame(uint32 *ptr_page_directory, struct FrameInfo *ptr_frame_info, uint
 	ptr_page_table[PTX(virtual_address)] = CONSTRUCT_ENTRY(physical_address , pte_available_bits | perm | PERM_PRESENT);
 	/*********************************************************************************/
 
+	if (virtual_address >= KERNEL_HEAP_START && virtual_address < KERNEL_HEAP_MAX)
+		ptr_frame_info->kheap_va = ROUNDDOWN(virtual_address, PAGE_SIZE);
+
 	return 0;
 }
 
+//
+// Allocate 'num_of_frames' free frames in a single hold of the frames lock and map them
+// to the contiguous range that starts at 'virtual_address' with 'perm|PERM_PRESENT'.
+// The PTEs are filled directly (no TLB invalidation is needed since none of them was present).
+//
+// Details
+//   - Missing page tables of the range are created first (outside the frames lock).
+//   - Nothing is allocated/mapped unless the whole request can be satisfied.
+//
+// RETURNS:
+//   0 on success
+//   E_NO_MEM if there are not enough free frames
+//   E_INVAL if a page in the range is already mapped
+//
+int allocate_and_map_frames(uint32 *ptr_page_directory, uint32 virtual_address, uint32 num_of_frames, int perm)
+{
+	virtual_address = ROUNDDOWN(virtual_address, PAGE_SIZE);
+	if (num_of_frames == 0)
+		return 0;
+	uint32 last_va = virtual_address + (num_of_frames - 1) * PAGE_SIZE;
+	uint32 *ptr_page_table;
+
+	//1. Make sure all page tables of the range exist
+	for (uint32 pdx = PDX(virtual_address); pdx <= PDX(last_va); pdx++)
+	{
+		uint32 va = pdx << PDXSHIFT;
+		if (get_page_table(ptr_page_directory, va, &ptr_page_table) == TABLE_NOT_EXIST)
+			create_page_table(ptr_page_directory, va);
+	}
+
+	bool lock_already_held = holding_kspinlock(&MemFrameLists.mfllock);
+	if (!lock_already_held)
+	{
+		acquire_kspinlock(&MemFrameLists.mfllock);
+	}
+	int ret = 0;
+	{
+		//2. Check the whole request before taking any frame (the hot frames of this CPU count too)
+		if (count_free_frames() - mycpu()->num_hot_frames < num_of_frames)
+			hot_frames_drain(mycpu(), 0);
+		if (count_free_frames() < num_of_frames)
+			ret = E_NO_MEM;
+		ptr_page_table = NULL;
+		for (uint32 i = 0; ret == 0 && i < num_of_frames; i++)
+		{
+			uint32 va = virtual_address + i * PAGE_SIZE;
+			if (ptr_page_table == NULL || PTX(va) == 0)
+				get_page_table(ptr_page_directory, va, &ptr_page_table);
+			if (ptr_page_table[PTX(va)] & PERM_PRESENT)
+				ret = E_INVAL;
+		}
+
+		//3. Take the frames and fill the PTEs (one table lookup per page table)
+		ptr_page_table = NULL;
+		for (uint32 i = 0; ret == 0 && i < num_of_frames; i++)
+		{
+			uint32 va = virtual_address + i * PAGE_SIZE;
+			if (ptr_page_table == NULL || PTX(va) == 0)
+				get_page_table(ptr_page_directory, va, &ptr_page_table);
+
+			struct FrameInfo *ptr_frame_info = take_free_frame();
+			ptr_frame_info->references = 1;
+			if (va >= KERNEL_HEAP_START && va < KERNEL_HEAP_MAX)
+				ptr_frame_info->kheap_va = va;
+
+			uint32 pte_available_bits = ptr_page_table[PTX(va)] & PERM_AVAILABLE;
+			ptr_page_table[PTX(va)] = CONSTRUCT_ENTRY(to_physical_address(ptr_frame_info), pte_available_bits | perm | PERM_PRESENT);
+		}
+	}
+	if (!lock_already_held)
+	{
+		release_kspinlock(&MemFrameLists.mfllock);
+	}
+	return ret;
+}
+
 //
 // Return the frame that is either
 //	1. mapped (i.e. present) at 'virtual_address'
@@ -482,6 +972,8 @@ void unmap_frame(uint32 *ptr_page_directory, uint32 virtual_address)
 	{
 		if (ptr_frame_info->isBuffered && !CHECK_IF_KERNEL_ADDRESS((uint32)virtual_address))
 			cprintf("WARNING: Freeing BUFFERED frame at va %x!!!\n", virtual_address) ;
+		if (ptr_frame_info->kheap_va == ROUNDDOWN(virtual_address, PAGE_SIZE))
+			ptr_frame_info->kheap_va = 0;
 		decrement_references(ptr_frame_info);
 
 		/*********************************************************************************/
@@ -519,7 +1011,7 @@ int loadtime_map_frame(uint32 *ptr_page_directory, struct FrameInfo *ptr_frame_i
 
 	if(USE_KHEAP && !CHECK_IF_KERNEL_ADDRESS(virtual_address))
 	{
-		ptr_page_table = (uint32*)kheap_virtual_address(EXTRACT_ADDRESS(page_directory_entry)) ;
+		ptr_page_table = user_page_table(ptr_page_directory, virtual_address, page_directory_entry) ;
 	}
 	else
 	{
@@ -558,10 +1050,9 @@ int loadtime_map_frame(uint32 *ptr_page_directory, struct FrameInfo *ptr_frame_i
 
 
 
-// calculate_available_frames:
+// calculate_available_frames: O(1) snapshot of the maintained list sizes and counters
 struct freeFramesCounters calculate_available_frames()
 {
-	struct FrameInfo *ptr;
 	uint32 totalFreeUnBuffered = 0 ;
 	uint32 totalFreeBuffered = 0 ;
 	uint32 totalModified = 0 ;
@@ -572,14 +1063,14 @@ struct freeFramesCounters calculate_available_frames()
 	}
 	{
 		//calculate the free frames from the free frame list
-
-		LIST_FOREACH(ptr, &MemFrameLists.free_frame_list)
-		{
-			if (ptr->isBuffered)
-				totalFreeBuffered++ ;
-			else
-				totalFreeUnBuffered++ ;
-		}
+		totalFreeBuffered = MemFrameLists.num_free_buffered ;
+		totalFreeUnBuffered = LIST_SIZE(&MemFrameLists.free_frame_list) - totalFreeBuffered ;
+
+		//the buddies, the hot frames of all CPUs and the pre-zeroed frames are free (and clean) too
+		totalFreeUnBuffered += MemFrameLists.buddy_num_free ;
+		for (int i = 0; i < NCPUS; i++)
+			totalFreeUnBuffered += CPUS[i].num_hot_frames ;
+		totalFreeUnBuffered += LIST_SIZE(&MemFrameLists.zeroed_frame_list) ;
 
 		/*2023: UPDATE based on suggestion from T112 2023.Term1*/
 		totalModified= LIST_SIZE(&MemFrameLists.modified_frame_list);
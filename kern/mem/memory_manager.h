@@ -27,8 +27,6 @@
 #define TABLE_IN_MEMORY 0
 #define TABLE_NOT_EXIST 1
 
-uint32 frame_to_va[1<<20];
-
 //***********************************
 /*2015*/ //USER HEAP STRATEGIES
 uint32 _UHeapPlacementStrategy;
@@ -42,6 +40,15 @@ uint32 memory_scarce_threshold_percentage;	// Memory remains plentiful till the
 #define DEFAULT_MEM_SCARCE_PERCENTAGE 25	// Default threshold % of free memory to indicate scarce MEM
 //***********************************
 
+//***********************************
+//Pre-zeroed frames pool: free frames zeroed ahead of time by the scheduler while it has nothing
+//to run, so that allocate_zeroed_frame() skips the 4 KB memset on the critical path
+#define ZEROED_FRAMES_POOL_SIZE		64		// max # frames kept in the pool
+#define ZEROED_FRAMES_IDLE_BATCH	4		// max # frames zeroed per idle round of the scheduler
+uint32 zeroedPoolHits;						// # allocate_zeroed_frame() served by the pool
+uint32 zeroedPoolMisses;					// # allocate_zeroed_frame() that zeroed synchronously
+//***********************************
+
 //***********************************
 /*DATA*/
 struct freeFramesCounters
@@ -57,12 +64,23 @@ struct freeFramesCounters
 int allocate_frame(struct FrameInfo **ptr_frame_info);
 void free_frame(struct FrameInfo *ptr_frame_info);
 int	map_frame(uint32 *ptr_page_directory, struct FrameInfo *ptr_frame_info, uint32 virtual_address, int perm);
+int allocate_and_map_frames(uint32 *ptr_page_directory, uint32 virtual_address, uint32 num_of_frames, int perm);
 void unmap_frame(uint32 *pgdir, uint32 virtual_address);
 int get_page_table(uint32 *ptr_page_directory, const uint32 virtual_address, uint32 **ptr_page_table);
 /*2016*/ void * create_page_table(uint32 *ptr_page_directory, const uint32 virtual_address);
 struct FrameInfo *get_frame_info(uint32 *ptr_page_directory, uint32 virtual_address, uint32 **ptr_page_table);
 void decrement_references(struct FrameInfo* ptr_frame_info);
 void initialize_frame_info(struct FrameInfo *ptr_frame_info);
+struct cpu;
+void hot_frames_refill(struct cpu *c);
+void hot_frames_drain(struct cpu *c, uint32 keep);
+int allocate_zeroed_frame(struct FrameInfo **ptr_frame_info);
+struct FrameInfo* allocate_contiguous_frames(uint32 order);
+void free_contiguous_frames(struct FrameInfo *ptr_frame_info, uint32 order);
+uint32 count_free_frames();
+void zeroed_frames_pool_init();
+void zeroed_frames_pool_refill(uint32 max_frames);
+void read_frame(struct FrameInfo *ptr_frame_info, void *dst);
 
 static inline uint32 to_frame_number(struct FrameInfo *ptr_frame_info)
 {
@@ -82,9 +100,44 @@ static inline struct FrameInfo* to_frame_info(uint32 physical_address)
 }
 
 void tlb_invalidate(uint32 *pgdir, void *ptr);
+#define TLB_INVLPG_MAX_PAGES	32	// above this # pages, a user range is invalidated by a full TLB flush
+void tlb_invalidate_range(uint32 *ptr_page_directory, uint32 virtual_address, uint32 size);
+void tlb_invalidate_page_table(uint32 *ptr_page_directory, uint32 virtual_address, uint32 *ptr_page_table);
+
+//***********************************
+//Self-mapped page tables (VPT)
+//PDX(VPT) of every directory points to the directory itself, so the tables of the LOADED
+//directory are visible as one array of PTEs at [VPT, VPT + PTSIZE) and its PDEs at vpd_entry().
+//Kernel tables are shared by all directories, so kernel PTEs are reachable whichever is loaded.
+//NOTE: changing a PDE must invalidate the TLB entry of its table in the VPT window too
+static inline bool is_loaded_directory(uint32 *ptr_page_directory)
+{
+	return EXTRACT_ADDRESS(ptr_page_directory[PDX(VPT)]) == rcr3();
+}
+static inline uint32* vpd_entry(uint32 virtual_address)
+{
+	return (uint32*)(VPT + (PDX(VPT) << PGSHIFT)) + PDX(virtual_address);
+}
+//The PDE of virtual_address must be present for the next two
+static inline uint32* vpt_table(uint32 virtual_address)
+{
+	return (uint32*)(VPT + (PDX(virtual_address) << PGSHIFT));
+}
+static inline uint32* vpt_entry(uint32 virtual_address)
+{
+	return (uint32*)VPT + (virtual_address >> PGSHIFT);
+}
 
 struct freeFramesCounters calculate_available_frames();
 
+//Whether the free frames went below memory_scarce_threshold_percentage of the memory (O(1))
+static inline bool is_memory_scarce()
+{
+	struct freeFramesCounters counters = calculate_available_frames();
+	uint32 num_free = counters.freeBuffered + counters.freeNotBuffered;
+	return num_free * 100 < memory_scarce_threshold_percentage * number_of_frames;
+}
+
 void __static_cpt(uint32 *ptr_directory, const uint32 virtual_address, uint32 **ptr_page_table);
 int loadtime_map_frame(uint32 *ptr_page_directory, struct FrameInfo *ptr_frame_info, uint32 virtual_address, int perm);
 
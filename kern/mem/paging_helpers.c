@@ -10,6 +10,29 @@
 /**************************************/
 /*[1] PAGE TABLE ENTRIES MANIPULATION */
 /**************************************/
+//Return a pointer to the PTE of the given VA, NULL if its page table doesn't exist.
+//For the loaded directory it's read through the VPT self-map, others go through get_page_table()
+static inline uint32* pt_entry(uint32* directory, uint32 virtual_address)
+{
+	if (is_loaded_directory(directory) && (*vpd_entry(virtual_address) & PERM_PRESENT) == PERM_PRESENT)
+		return vpt_entry(virtual_address);
+	uint32* ptr_page_table ;
+	get_page_table(directory, virtual_address, &ptr_page_table);
+	return (ptr_page_table == NULL) ? NULL : &ptr_page_table[PTX(virtual_address)];
+}
+
+//Return the kernel VA of the (present) page table of the given VA, NULL if it doesn't exist.
+//Unlike get_page_table(), it's never the VPT window, so it stays valid once its PDE is cleared
+static inline uint32* pde_page_table(uint32* directory, uint32 virtual_address)
+{
+	uint32 page_directory_entry = directory[PDX(virtual_address)];
+	if ((page_directory_entry & PERM_PRESENT) != PERM_PRESENT)
+		return NULL;
+	if (USE_KHEAP && !CHECK_IF_KERNEL_ADDRESS(virtual_address))
+		return (uint32*)kheap_virtual_address(EXTRACT_ADDRESS(page_directory_entry));
+	return STATIC_KERNEL_VIRTUAL_ADDRESS(EXTRACT_ADDRESS(page_directory_entry));
+}
+
 //===============================
 //1) UPDATE PAGE PERMISSIONS
 //===============================
@@ -20,16 +43,13 @@
 //REMEMBER: to invalidate the TLB cache
 inline void pt_set_page_permissions(uint32* directory, uint32 virtual_address, uint32 permissions_to_set, uint32 permissions_to_clear)
 {
-	//[1] Get the table
-	uint32* ptr_page_table ;
-	int ret = get_page_table(directory, virtual_address, &ptr_page_table);
+	//[1] Get the entry
+	uint32* ptr_entry = pt_entry(directory, virtual_address);
 
 	//[2] If exists, update permissions
-	if (ptr_page_table != NULL)
+	if (ptr_entry != NULL)
 	{
-		ptr_page_table[PTX(virtual_address)] |= (permissions_to_set);
-		ptr_page_table[PTX(virtual_address)] &= (~permissions_to_clear);
-
+		*ptr_entry = (*ptr_entry | permissions_to_set) & ~permissions_to_clear;
 	}
 	//[3] Else, should "panic" since the table should be exist
 	else
@@ -55,19 +75,25 @@ inline int pt_get_page_permissions(uint32* directory, uint32 virtual_address )
 	//Comment the following line
 	//panic("pt_get_page_permissions() is not implemented yet!");
 
-	uint32 pt_index = PTX(virtual_address);
-
-	    uint32 *pt = NULL;
-	    int ret = get_page_table(directory, virtual_address, &pt);
+	    uint32 *ptr_entry = pt_entry(directory, virtual_address);
+	    if (ptr_entry == NULL)
+	        return 0;
 
-	    uint32 pte = pt[pt_index];
+	    uint32 pte = *ptr_entry;
 
 	    // Page entry missing = page NOT mapped
 	    if ((pte & PERM_PRESENT) == 0)
 	        return 0;
 
-	    // Return PERMISSIONS ONLY
-	    return (pte & 0xFFF);
+	    // Return PERMISSIONS ONLY (GLOBAL is a TLB attribute of kernel pages, not a permission)
+	    return (pte & 0xFFF & ~PERM_GLOBAL);
+}
+
+//Return a pointer to the PTE of the given VA (one table lookup), NULL if its page table doesn't exist.
+//Changing the entry through it must be followed by tlb_invalidate()
+inline uint32* pt_get_page_table_entry(uint32* directory, uint32 virtual_address)
+{
+	return pt_entry(directory, virtual_address);
 }
 
 //===============================
@@ -79,9 +105,14 @@ inline int pt_get_page_permissions(uint32* directory, uint32 virtual_address )
 //REMEMBER: to invalidate the TLB cache
 inline void pt_clear_page_table_entry(uint32* directory, uint32 virtual_address)
 {
-	//TODO: PRACTICE: fill this function.
-	//Comment the following line
-	panic("pt_clear_page_table_entry() is not implemented yet!");
+	uint32* ptr_entry = pt_entry(directory, virtual_address);
+	if (ptr_entry == NULL)
+	{
+		cprintf("va=%x not exist and has no page table\n", virtual_address);
+		panic("function pt_clear_page_table_entry() called with invalid virtual address. The corresponding page table doesn't exist\n") ;
+	}
+	*ptr_entry = 0;
+	tlb_invalidate(directory, (void *)virtual_address);
 }
 
 /***********************************************************************************************/
@@ -151,7 +182,8 @@ inline int alloc_page(uint32* directory, uint32 va, uint32 perms, bool set_to_ze
 		return 1;
 	}
 	else {
-		int ret = allocate_frame(&ptr_fi);
+		// a zeroed frame comes from the pre-zeroed pool (if it has stock) instead of a memset here
+		int ret = set_to_zero ? allocate_zeroed_frame(&ptr_fi) : allocate_frame(&ptr_fi);
 		if (ret == E_NO_MEM) {
 			return E_NO_MEM;
 		}
@@ -160,9 +192,6 @@ inline int alloc_page(uint32* directory, uint32 va, uint32 perms, bool set_to_ze
 			free_frame(ptr_fi);
 			return E_NO_MEM;
 		}
-		if (set_to_zero) {
-			memset((void*)va, 0, PAGE_SIZE);
-		}
 		return 0;
 	}
 }
@@ -198,12 +227,18 @@ inline void del_page_table(uint32* page_dir, uint32 va)
 	//panic("Function is not implemented yet!");
 
 	// get the page table of the given virtual address
-	uint32 * ptr_page_table ;
-	get_page_table(ptr_page_directory, va, &ptr_page_table);
+	uint32 * ptr_page_table = pde_page_table(page_dir, va);
 
 	if (ptr_page_table == NULL)
 		return ;
 
+	// set the corresponding entry in the directory to 0
+	uint32 dir_index = PDX(va);
+	page_dir[dir_index] = 0;
+
+	//invalidate the TLB entries of the table (while it still exists)
+	tlb_invalidate_page_table(page_dir, va, ptr_page_table);
+
 #if USE_KHEAP
 	// directly remove the page table from the kernel heap
 	kfree(ptr_page_table);
@@ -217,13 +252,6 @@ inline void del_page_table(uint32* page_dir, uint32 va)
 	table_frame_info->references = 0;
 	free_frame(table_frame_info);
 #endif
-
-	// set the corresponding entry in the directory to 0
-	uint32 dir_index = PDX(va);
-	ptr_page_directory[dir_index] = 0;
-
-	//clear the TLB cache
-	tlbflush();
 }
 
 
@@ -249,6 +277,8 @@ inline void pd_set_table_unused(uint32* directory, uint32 virtual_address)
 
 inline void pd_clear_page_dir_entry(uint32* directory, uint32 virtual_address)
 {
+	uint32 * ptr_page_table = pde_page_table(directory, virtual_address);
 	directory[PDX(virtual_address)] = 0 ;
-	tlbflush();
+	if (ptr_page_table != NULL)
+		tlb_invalidate_page_table(directory, virtual_address, ptr_page_table);
 }
@@ -8,28 +8,160 @@
 #include <kern/trap/fault_handler.h>
 #include <kern/disk/pagefile_manager.h>
 #include "kheap.h"
+#include "kmem_cache.h"
 #include "memory_manager.h"
 
 ///============================================================================================
 /// Dealing with environment working set
 #if USE_KHEAP
+struct kmem_cache *ws_element_cache;
+
+static void ws_element_ctor(void *obj)
+{
+	memset(obj, 0, sizeof(struct WorkingSetElement));
+}
+
+//==============================
+// [0] CREATE THE WS OBJECT CACHE
+//==============================
+void env_page_ws_caches_init()
+{
+	ws_element_cache = kmem_cache_create("WS elements", sizeof(struct WorkingSetElement), ws_element_ctor);
+}
+
+//==============================
+// [1] WS RING OF AN ENV
+//==============================
+//The WS elements of an env are slots of one contiguous array (its ring), so that walking the
+//page_WS_list (e.g. by the CLOCK hand) stays within a few cache lines instead of chasing heap
+//pointers. Elements come from the ws_element_cache only if the ring couldn't be allocated.
+void env_page_ws_ring_init(struct Env* e)
+{
+	LIST_INIT(&(e->page_WS_free_slots));
+	e->page_WS_ring = kmalloc(sizeof(struct WorkingSetElement) * e->page_WS_max_size);
+	if (e->page_WS_ring == NULL)
+		return;
+	memset(e->page_WS_ring, 0, sizeof(struct WorkingSetElement) * e->page_WS_max_size);
+	for (int i = e->page_WS_max_size - 1; i >= 0; i--)
+		LIST_INSERT_HEAD(&(e->page_WS_free_slots), &(e->page_WS_ring[i]));
+}
+
+void env_page_ws_ring_free(struct Env* e)
+{
+	if (e->page_WS_ring != NULL)
+		kfree(e->page_WS_ring);
+	e->page_WS_ring = NULL;
+	LIST_INIT(&(e->page_WS_free_slots));
+}
+
 //==============================
-// [1] CREATE A NEW WS ELEMENT
+// [2] CREATE A NEW WS ELEMENT
 //==============================
 //If failed to create a new one, kernel should panic()!
 inline struct WorkingSetElement* env_page_ws_list_create_element(struct Env* e, uint32 virtual_address)
 {
 	assert(virtual_address >= 0 && virtual_address < USER_TOP);
-	struct WorkingSetElement *wse = kmalloc(sizeof(struct WorkingSetElement)) ;
+	struct WorkingSetElement *wse = LIST_FIRST(&(e->page_WS_free_slots));
+	if (wse != NULL)
+		LIST_REMOVE(&(e->page_WS_free_slots), wse);
+	else
+		wse = kmem_cache_alloc(ws_element_cache) ;
 	if (wse == NULL)
 	{
 		panic("can't create a new WS element");
 	}
 	wse->virtual_address = ROUNDDOWN(virtual_address,PAGE_SIZE);
+	wse->prefetched = 0;
 	wse->sweeps_counter = 0;
 	wse->time_stamp = 0x00000000;
 	return wse;
 }
+
+//==============================
+// [3] FREE A WS ELEMENT
+//==============================
+//The element must be already removed from its list
+inline void env_page_ws_free_element(struct Env* e, struct WorkingSetElement* wse)
+{
+	if (e->page_WS_ring != NULL && wse >= e->page_WS_ring && wse < e->page_WS_ring + e->page_WS_max_size)
+		LIST_INSERT_HEAD(&(e->page_WS_free_slots), wse);
+	else
+		kmem_cache_free(ws_element_cache, wse);
+}
+
+//==============================
+// [4] LRU AGING OF THE WS
+//==============================
+//Each step shifts right the time stamp of each WS element, with its used bit (then cleared) as
+//the new MSB. The aging is kept eager: the hardware keeps no history of the used bits, so any
+//deferred aging would have to sample every PTE at each step anyway to pick the same victims.
+//The PTE is tested & cleared through a single lookup
+void env_page_ws_age_step(struct Env* e)
+{
+	struct WorkingSetElement *wse;
+	LIST_FOREACH(wse, &(e->page_WS_list))
+	{
+		wse->time_stamp >>= 1;
+		uint32 *ptr_entry = pt_get_page_table_entry(e->env_page_directory, wse->virtual_address);
+		if (ptr_entry != NULL && (*ptr_entry & PERM_USED))
+		{
+			wse->time_stamp |= 0x80000000;
+			env_page_ws_note_used(e, wse);
+			*ptr_entry &= ~PERM_USED;
+			tlb_invalidate(e->env_page_directory, (void*)wse->virtual_address);
+		}
+	}
+}
+
+//LRU time approx.: the victim is the (first) WS element with the least time stamp
+struct WorkingSetElement* env_page_ws_lru_select_victim(struct Env* e)
+{
+	struct WorkingSetElement *victim = NULL, *wse;
+	LIST_FOREACH(wse, &(e->page_WS_list))
+	{
+		if (victim == NULL || wse->time_stamp < victim->time_stamp)
+			victim = wse;
+	}
+	return victim;
+}
+
+//==============================
+// [5] PAGE REFERENCE STREAM
+//==============================
+//Append a reference to the page of virtual_address: it extends the last run if it's the same page,
+//else it starts a new one (the array of runs is doubled when full).
+//If failed to extend the stream, kernel should panic()!
+void env_page_ref_stream_add(struct Env* e, uint32 virtual_address)
+{
+	struct PageRefStream *stream = &(e->referenceStream);
+	uint32 page_number = virtual_address >> PGSHIFT;
+	stream->num_refs++;
+	if (stream->num_runs > 0 && stream->runs[stream->num_runs - 1].page_number == page_number)
+	{
+		stream->runs[stream->num_runs - 1].count++;
+		return;
+	}
+	if (stream->num_runs == stream->max_runs)
+	{
+		uint32 max_runs = (stream->max_runs == 0) ? 64 : 2 * stream->max_runs;
+		struct PageRefRun *runs = krealloc(stream->runs, max_runs * sizeof(struct PageRefRun));
+		if (runs == NULL)
+			panic("can't extend the page reference stream");
+		stream->runs = runs;
+		stream->max_runs = max_runs;
+	}
+	stream->runs[stream->num_runs].page_number = page_number;
+	stream->runs[stream->num_runs].count = 1;
+	stream->num_runs++;
+}
+
+void env_page_ref_stream_free(struct Env* e)
+{
+	if (e->referenceStream.runs != NULL)
+		kfree(e->referenceStream.runs);
+	memset(&(e->referenceStream), 0, sizeof(e->referenceStream));
+}
+
 inline void env_page_ws_invalidate(struct Env* e, uint32 virtual_address)
 {
 	if (isPageReplacmentAlgorithmLRU(PG_REP_LRU_LISTS_APPROX))
@@ -45,7 +177,7 @@ inline void env_page_ws_invalidate(struct Env* e, uint32 virtual_address)
 
 				LIST_REMOVE(&(e->ActiveList), ptr_WS_element);
 
-				/*EDIT*/kfree(ptr_WS_element);
+				/*EDIT*/env_page_ws_free_element(e, ptr_WS_element);
 
 				if(ptr_tmp_WS_element != NULL)
 				{
@@ -68,7 +200,7 @@ inline void env_page_ws_invalidate(struct Env* e, uint32 virtual_address)
 					unmap_frame(e->env_page_directory, ptr_WS_element->virtual_address);
 					LIST_REMOVE(&(e->SecondList), ptr_WS_element);
 
-					kfree(ptr_WS_element);
+					env_page_ws_free_element(e, ptr_WS_element);
 
 					/*EDIT*/break;
 				}
@@ -90,7 +222,7 @@ inline void env_page_ws_invalidate(struct Env* e, uint32 virtual_address)
 				}
 				LIST_REMOVE(&(e->page_WS_list), wse);
 
-				kfree(wse);
+				env_page_ws_free_element(e, wse);
 
 				break;
 			}
@@ -15,8 +15,33 @@ void env_page_ws_print(struct Env *curenv);
 inline void env_page_ws_invalidate(struct Env* e, uint32 virtual_address);
 
 #if USE_KHEAP
+// Object cache of the WS elements of an env whose WS ring couldn't be allocated (see kmem_cache.h)
+extern struct kmem_cache *ws_element_cache;
+void env_page_ws_caches_init();
 /*2024*/
 inline struct WorkingSetElement* env_page_ws_list_create_element(struct Env* e, uint32 virtual_address);
+void env_page_ws_ring_init(struct Env* e);
+void env_page_ws_ring_free(struct Env* e);
+inline void env_page_ws_free_element(struct Env* e, struct WorkingSetElement* wse);
+
+// LRU time approx. aging (one step per tick & per fault)
+void env_page_ws_age_step(struct Env* e);
+struct WorkingSetElement* env_page_ws_lru_select_victim(struct Env* e);
+
+// Fault-around: a prefetched page is a prefetch hit the first time its used bit is found set
+// (by the replacement or the aging), it's an ordinary WS element since then
+static inline void env_page_ws_note_used(struct Env* e, struct WorkingSetElement* wse)
+{
+	if (wse->prefetched)
+	{
+		wse->prefetched = 0;
+		e->nPrefetchHits++;
+	}
+}
+
+// Page reference stream (OPTIMAL)
+void env_page_ref_stream_add(struct Env* e, uint32 virtual_address);
+void env_page_ref_stream_free(struct Env* e);
 #else
 inline uint32 env_page_ws_get_size(struct Env *e);
 inline void env_page_ws_set_entry(struct Env* e, uint32 entry_index, uint32 virtual_address);
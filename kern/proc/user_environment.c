@@ -343,14 +343,11 @@ struct Env* env_create(char* user_program_name, unsigned int page_WS_size, unsig
 		uint32 stackVa = USTACKTOP - PAGE_SIZE;
 		for(;stackVa >= ptr_user_stack_bottom; stackVa -= PAGE_SIZE)
 		{
-			//allocate and map
+			//allocate a page initialized by 0's and map it
 			struct FrameInfo *pp = NULL;
-			allocate_frame(&pp);
+			allocate_zeroed_frame(&pp);
 			loadtime_map_frame(e->env_page_directory, pp, stackVa, PERM_USER | PERM_WRITEABLE);
 
-			//initialize new page by 0's
-			memset((void*)stackVa, 0, PAGE_SIZE);
-
 			//now add it to the working set and the page table
 			{
 #if USE_KHEAP
@@ -692,8 +689,10 @@ void switchuvm(struct Env *proc)
 	// Load the TSS
 	ltr(GD_TSS);
 
-	//load the user page directory
-	lcr3(c->proc->env_cr3) ;
+	//load the user page directory, unless it's already loaded (i.e. the scheduler re-selected
+	//the env that just ran): reloading CR3 would needlessly flush its user TLB entries
+	if (rcr3() != c->proc->env_cr3)
+		lcr3(c->proc->env_cr3) ;
 
 	popcli();	//enable interrupt
 }
@@ -735,6 +734,12 @@ int allocate_environment(struct Env** e)
 // Free the given environment "e", simply by adding it to the free environment list.
 void free_environment(struct Env* e)
 {
+#if USE_KHEAP
+	env_page_ws_ring_free(e);
+	env_page_ref_stream_free(e);
+	if (e->optimal_active_VAs != NULL)
+		kfree(e->optimal_active_VAs);
+#endif
 	memset(e, 0, sizeof(*e));
 	e->env_status = ENV_FREE;
 	LIST_INSERT_HEAD(&env_free_list, e);
@@ -974,6 +979,9 @@ void initialize_environment(struct Env* e, uint32* ptr_user_page_directory, unsi
 	{
 		e->env_page_directory[i] = ptr_page_directory[i] ;
 	}
+	//the copied VPT entry self-maps the kernel directory: point it to this one before the
+	//directory is used (is_loaded_directory() relies on it)
+	e->env_page_directory[PDX(VPT)]  = e->env_cr3 | PERM_PRESENT | PERM_WRITEABLE;
 
 	/*2024
 	 * Create the User Kernel Stack for this process (to be used for the trap/interrupt)
@@ -1009,7 +1017,10 @@ void initialize_environment(struct Env* e, uint32* ptr_user_page_directory, unsi
 #if USE_KHEAP == 1
 	{
 		LIST_INIT(&(e->page_WS_list));
-		LIST_INIT(&(e->referenceStreamList));
+		memset(&(e->referenceStream), 0, sizeof(e->referenceStream));
+		e->optimal_active_VAs = NULL;
+		e->optimal_num_active = 0;
+		env_page_ws_ring_init(e);
 	}
 #else
 	{
@@ -1067,6 +1078,9 @@ void initialize_environment(struct Env* e, uint32* ptr_user_page_directory, unsi
 	e->nPageIn = 0;
 	e->nPageOut = 0;
 	e->nNewPageAdded = 0;
+	e->nPageReclaimed = 0;
+	e->nPagePrefetched = 0;
+	e->nPrefetchHits = 0;
 
 	//e->shared_free_address = USER_SHARED_MEM_START;
 
@@ -1211,8 +1225,8 @@ struct ProgramSegment PROGRAM_SEGMENT_FIRST( uint8* ptr_program_start)
 //===============================================================================
 void cleanup_buffers(struct Env* e)
 {
-	//NEW !! 2016, remove remaining pages in the modified list
-	struct FrameInfo *ptr_fi=NULL ;
+	//NEW !! 2016, remove remaining pages in the modified list (and the free list)
+	struct FrameInfo *ptr_fi=NULL, *ptr_next=NULL ;
 
 	//	cprintf("[%s] deleting modified at end of env\n", curenv->prog_name);
 	//	struct freeFramesCounters ffc = calculate_available_frames();
@@ -1224,12 +1238,14 @@ void cleanup_buffers(struct Env* e)
 		acquire_kspinlock(&MemFrameLists.mfllock);
 	}
 	{
-		LIST_FOREACH(ptr_fi, &MemFrameLists.modified_frame_list)
-						{
+		//the next frame is saved since free_frame() clears the links of the removed one
+		for (ptr_fi = LIST_FIRST(&MemFrameLists.modified_frame_list); ptr_fi != NULL; ptr_fi = ptr_next)
+		{
+			ptr_next = LIST_NEXT(ptr_fi);
 			if(ptr_fi->proc == e)
 			{
 				/*MUST UN-COMMENT THIS LINE*/
-				//pt_clear_page_table_entry(ptr_fi->proc->env_page_directory,ptr_fi->va);
+				pt_clear_page_table_entry(ptr_fi->proc->env_page_directory,ptr_fi->va);
 
 				//cprintf("==================\n");
 				//cprintf("[%s] ptr_fi = %x, ptr_fi next = %x \n",curenv->prog_name, ptr_fi, LIST_NEXT(ptr_fi));
@@ -1240,7 +1256,18 @@ void cleanup_buffers(struct Env* e)
 				//cprintf("[%s] ptr_fi = %x, ptr_fi next = %x, saved next = %x \n", curenv->prog_name ,ptr_fi, LIST_NEXT(ptr_fi), ___ptr_next);
 				//cprintf("==================\n");
 			}
-						}
+		}
+		for (ptr_fi = LIST_FIRST(&MemFrameLists.free_frame_list); ptr_fi != NULL; ptr_fi = ptr_next)
+		{
+			ptr_next = LIST_NEXT(ptr_fi);
+			if(ptr_fi->proc == e)
+			{
+				pt_clear_page_table_entry(ptr_fi->proc->env_page_directory,ptr_fi->va);
+				LIST_REMOVE(&MemFrameLists.free_frame_list, ptr_fi);
+				MemFrameLists.num_free_buffered--;
+				free_frame(ptr_fi);
+			}
+		}
 	}
 	if (!lock_already_held)
 	{
@@ -553,6 +553,63 @@ int test_virtual_to_physical()
 
 	return 0;
 }
+
+//=====================================
+// 5) TLB INVALIDATION BENCHMARK:
+//=====================================
+//Simulate page faults on a working set of user pages of the loaded directory: each "fault" rewrites
+//the PTE of one page, refreshes the TLB, then touches the whole working set again. The TLB is
+//refreshed either by a full flush (CR3 reload, as the fault handler used to do) or by invlpg of
+//the faulted page only (as it does now)
+#define TLB_BENCH_VA				0x80000000
+#define TLB_BENCH_NUM_OF_PAGES		64
+#define TLB_BENCH_NUM_OF_FAULTS		4096
+static uint32 tlb_bench_cycles_per_fault(uint32 *ptr_page_table, bool full_flush)
+{
+	volatile char sum = 0;
+	uint64 t1 = read_tsc();
+	for (int f = 0; f < TLB_BENCH_NUM_OF_FAULTS; f++)
+	{
+		uint32 va = TLB_BENCH_VA + (f % TLB_BENCH_NUM_OF_PAGES) * PAGE_SIZE;
+		ptr_page_table[PTX(va)] &= ~PERM_USED;
+		if (full_flush)
+			tlbflush();
+		else
+			invlpg((void*)va);
+		for (int p = 0; p < TLB_BENCH_NUM_OF_PAGES; p++)
+			sum += *((char*)TLB_BENCH_VA + p * PAGE_SIZE);
+	}
+	uint64 t2 = read_tsc();
+	return (uint32)((t2 - t1) / TLB_BENCH_NUM_OF_FAULTS);
+}
+
+int test_tlb_invalidation_cost()
+{
+	uint32 *ptr_page_table = NULL;
+	for (int p = 0; p < TLB_BENCH_NUM_OF_PAGES; p++)
+	{
+		struct FrameInfo *ptr_frame_info;
+		allocate_frame(&ptr_frame_info);
+		map_frame(ptr_page_directory, ptr_frame_info, TLB_BENCH_VA + p * PAGE_SIZE, PERM_WRITEABLE);
+	}
+	get_page_table(ptr_page_directory, TLB_BENCH_VA, &ptr_page_table);
+
+	//warm up, then measure each method
+	tlb_bench_cycles_per_fault(ptr_page_table, 0);
+	uint32 flushCycles = tlb_bench_cycles_per_fault(ptr_page_table, 1);
+	uint32 invlpgCycles = tlb_bench_cycles_per_fault(ptr_page_table, 0);
+
+	for (int p = 0; p < TLB_BENCH_NUM_OF_PAGES; p++)
+		unmap_frame(ptr_page_directory, TLB_BENCH_VA + p * PAGE_SIZE);
+	del_page_table(ptr_page_directory, TLB_BENCH_VA);
+
+	cprintf("%d simulated faults over a working set of %d pages:\n", TLB_BENCH_NUM_OF_FAULTS, TLB_BENCH_NUM_OF_PAGES);
+	cprintf("	full TLB flush: %d cycles/fault = %d faults per 1M cycles\n", flushCycles, 1000000 / (flushCycles ? flushCycles : 1));
+	cprintf("	invlpg        : %d cycles/fault = %d faults per 1M cycles\n", invlpgCycles, 1000000 / (invlpgCycles ? invlpgCycles : 1));
+	cprintf("	=> invlpg handles x%d.%02d faults/sec\n", flushCycles / (invlpgCycles ? invlpgCycles : 1),
+			(flushCycles * 100 / (invlpgCycles ? invlpgCycles : 1)) % 100);
+	return 0;
+}
 //===============================================================================================
 
 /*******************************/
@@ -17,20 +17,31 @@
 /***********************************************************************************************************************/
 #define Mega  (1024*1024)
 #define kilo (1024)
-#define numOfLevels (LOG2_MAX_SIZE - LOG2_MIN_SIZE + 1)
+#define numOfLevels NUM_OF_BLOCK_CLASSES
+#define NEXT_BLK_SIZE(size) class_to_size(size_to_class(size) + 1)
+#define PREV_BLK_SIZE(size) (size_to_class(size) == 0 ? 0 : class_to_size(size_to_class(size) - 1))
 
 short* startVAsInit[DYN_ALLOC_MAX_BLOCK_SIZE + 1] ;
 short* endVAsInit[DYN_ALLOC_MAX_BLOCK_SIZE + 1] ;
 
 __inline__ uint8 IDX(uint32 size)
 {
-	size>>= LOG2_MIN_SIZE;
-	int index = 0;
-	while ((size>>=1) != 0)
+	return size_to_class(size);
+}
+
+//# of pages consumed by allocating one block of each size in [1, DYN_ALLOC_MAX_BLOCK_SIZE]
+uint32 pages_of_one_block_per_size()
+{
+	uint32 numOfPages = 0;
+	uint32 prevSize = 0;
+	for (int i = 0; i < numOfLevels; ++i)
 	{
-		index++;
+		uint32 curSize = class_to_size(i);
+		uint32 numOfBlksPerPage = PAGE_SIZE / curSize;
+		numOfPages += ROUNDUP(curSize - prevSize, numOfBlksPerPage) / numOfBlksPerPage;
+		prevSize = curSize;
 	}
-	return index;
+	return numOfPages;
 }
 
 int check_dynalloc_datastruct(uint32 curSize, uint32 numOfBlksAtCurSize)
@@ -150,7 +161,7 @@ void test_initialize_dynamic_allocator()
 	}
 	//Check#4: freeBlockLists
 	cprintf_colored(TEXT_cyan, "\nCheck#4: freeBlockLists \n");
-	int numOfSizes = LOG2_MAX_SIZE - LOG2_MIN_SIZE + 1;
+	int numOfSizes = NUM_OF_BLOCK_CLASSES;
 	for (int i = 0; i < numOfSizes; ++i)
 	{
 		struct BlockElement_List *ptrList = &freeBlockLists[i];
@@ -179,7 +190,7 @@ int test_initial_alloc()
 
 	//Remove the current 1-to-1 mapping of the KERNEL HEAP area since the USE_KHEAP = 0 for this test
 	uint32 startDA = KERNEL_HEAP_START ;
-	uint32 sizeDA = 0x2AE000 ;
+	uint32 sizeDA = pages_of_one_block_per_size() * PAGE_SIZE ;
 	uint32 endDA = KERNEL_HEAP_START + sizeDA ;
 	remove_current_mappings(startDA, endDA);
 	initialize_dynamic_allocator(startDA, endDA);
@@ -196,6 +207,8 @@ int test_initial_alloc()
 	int numOfBlksAtCurSize = 0;
 	int maxNumOfBlksAtCurPage = PAGE_SIZE / curSize;
 	uint32 expectedVA = KERNEL_HEAP_START;
+	//checks are counted per size class and rescaled, since the # of classes depends on DYN_ALLOC_SUBCLASS_BITS
+	int numOfChecks = 0, numOfPassedChecks = 0;
 	for (int s = 1; s <= DYN_ALLOC_MAX_BLOCK_SIZE; ++s)
 	{
 		va = alloc_block(s);
@@ -210,10 +223,11 @@ int test_initial_alloc()
 		}
 		if (s == curSize)
 		{
-			//apply the following check only on the 1st three levels
+			//apply the following check only on the levels up to 32B
 			if (curSize <= 32)
 			{
-				if (is_correct)	eval += 5;
+				numOfChecks++;
+				if (is_correct)	numOfPassedChecks++;
 				is_correct = 1;
 			}
 			if (check_dynalloc_datastruct(curSize, numOfBlksAtCurSize) == 0)
@@ -221,10 +235,11 @@ int test_initial_alloc()
 				is_correct = 0;
 				cprintf_colored(TEXT_TESTERR_CLR, "alloc_block test#2.%d: WRONG! DA data structures are not correct\n", s);
 			}
-			if (is_correct)	eval += 5;
+			numOfChecks++;
+			if (is_correct)	numOfPassedChecks++;
 			//Reinitialize
 			{
-				curSize <<= 1;
+				curSize = NEXT_BLK_SIZE(curSize);
 				expectedVA += PAGE_SIZE;
 				numOfBlksAtCurSize = 0;
 				maxNumOfBlksAtCurPage = PAGE_SIZE / curSize;
@@ -237,6 +252,7 @@ int test_initial_alloc()
 		}
 
 	}
+	eval += 60 * numOfPassedChecks / numOfChecks;
 
 	//====================================================================//
 	/*INITIAL ALLOC Scenario 2: Allocate blocks of same size that consume remaining free blocks at all levels*/
@@ -266,12 +282,13 @@ int test_initial_alloc()
 			prevAllocPages += numOfAllocBlks / expectedNumOfBlksPerPage;
 		}
 		size1 = size2 ;
-		size2 *= 2 ;
+		size2 = NEXT_BLK_SIZE(size2) ;
 		idx++;
 	}
 
 	//Allocate a number of blocks of same size to consume all the remaining free blocks
 	int blkSize = 1<<LOG2_MIN_SIZE ;
+	numOfChecks = numOfPassedChecks = 0;
 	for (int i = 0; i < numOfLevels; ++i)
 	{
 		uint32 expectedVA = KERNEL_HEAP_START + expectedPageIndex[i] * PAGE_SIZE;
@@ -307,9 +324,12 @@ int test_initial_alloc()
 				is_correct = 0;
 				cprintf_colored(TEXT_TESTERR_CLR, "alloc_block test#6: WRONG! there's still free blocks at page %d while not expected to\n", expectedPageIndex[i]);
 			}
-			if (is_correct)	eval += 5;
+			numOfChecks++;
+			if (is_correct)	numOfPassedChecks++;
 		}
 	}
+	if (numOfChecks > 0)
+		eval += 20 * numOfPassedChecks / numOfChecks;
 
 	//====================================================================//
 	/*INITIAL ALLOC Scenario 3: Check stored data inside each allocated block*/
@@ -334,7 +354,7 @@ int test_initial_alloc()
 	cprintf_colored(TEXT_cyan, "\n4: Check allocated frames\n\n") ;
 	is_correct = 1;
 	int freeFramesAfter = sys_calculate_free_frames();
-	int expectedNumOfAllocPages = 686;
+	int expectedNumOfAllocPages = pages_of_one_block_per_size();
 	if (freeFramesBefore - freeFramesAfter != expectedNumOfAllocPages)
 	{
 		is_correct = 0;
@@ -385,7 +405,7 @@ void test_free_block()
 
 	//Remove the current 1-to-1 mapping of the KERNEL HEAP area since the USE_KHEAP = 0 for this test
 	uint32 startDA = KERNEL_HEAP_START ;
-	uint32 sizeDA = 0x2AE000 ;
+	uint32 sizeDA = pages_of_one_block_per_size() * PAGE_SIZE ;
 	uint32 endDA = KERNEL_HEAP_START + sizeDA ;
 	remove_current_mappings(startDA, endDA);
 	initialize_dynamic_allocator(startDA, endDA);
@@ -421,7 +441,7 @@ void test_free_block()
 			}
 			//Reinitialize
 			{
-				curSize <<= 1;
+				curSize = NEXT_BLK_SIZE(curSize);
 				expectedVA += PAGE_SIZE;
 				numOfBlksAtCurSize = 0;
 				maxNumOfBlksAtCurPage = PAGE_SIZE / curSize;
@@ -462,7 +482,7 @@ void test_free_block()
 			prevAllocPages += numOfAllocBlks[idx] / expectedNumOfBlksPerPage;
 		}
 		size1 = size2 ;
-		size2 *= 2 ;
+		size2 = NEXT_BLK_SIZE(size2) ;
 		idx++;
 	}
 
@@ -491,7 +511,7 @@ void test_free_block()
 			is_correct = 1;
 			//Reinitialize
 			{
-				curSize <<= 1;
+				curSize = NEXT_BLK_SIZE(curSize);
 				idx++ ;
 				maxNumOfBlksAtCurPage = PAGE_SIZE / curSize;
 			}
@@ -567,19 +587,19 @@ void test_free_block()
 
 		//Move to next block size
 		{
-			curSize <<= 1;
+			curSize = NEXT_BLK_SIZE(curSize);
 			idx++ ;
 		}
 	}
-	//rescale to 60% instead of 80%
-	eval = eval * 60 / 80;
+	//rescale to 60% (20% are given above for each of the levels that consume ONLY 1 page)
+	eval = eval * 60 / (20 * nextIdx);
 
 
 	//====================================================================//
 	/*FREE: Remove all blocks for each of the remaining block sizes*/
 	cprintf_colored(TEXT_cyan, "\n4: Remove all blocks for each of the remaining block sizes  [20%]\n") ;
 	curSize = nextSize ;
-	int startSize = (nextSize>>1) + 1;
+	int startSize = PREV_BLK_SIZE(nextSize) + 1;
 	idx = nextIdx;
 	is_correct = 1;
 	for (int s = startSize; s <= DYN_ALLOC_MAX_BLOCK_SIZE; ++s)
@@ -602,7 +622,7 @@ void test_free_block()
 			}
 			//Reinitialize
 			{
-				curSize <<= 1;
+				curSize = NEXT_BLK_SIZE(curSize);
 				idx++ ;
 			}
 		}
@@ -653,6 +673,60 @@ void test_free_block()
 
 }
 
+//Run an allocation workload on a fresh DA and report its internal (block rounding) and
+//page-level (block rounding + unused page tails + partially-filled pages) fragmentation
+static void report_fragmentation(char *workload, uint32 *sizes, int numOfAllocs)
+{
+	uint32 startDA = KERNEL_HEAP_START ;
+	uint32 endDA = KERNEL_HEAP_START + DYN_ALLOC_MAX_SIZE ;
+	remove_current_mappings(startDA, endDA);
+	initialize_dynamic_allocator(startDA, endDA);
+
+	int freeFramesBefore = sys_calculate_free_frames();
+	uint32 requested = 0, allocated = 0;
+	for (int i = 0; i < numOfAllocs; ++i)
+	{
+		void *va = alloc_block(sizes[i]);
+		if (va == NULL)
+			panic("fragmentation: alloc_block(%d) failed", sizes[i]);
+		requested += sizes[i];
+		allocated += get_block_size(va);
+	}
+	int numOfPages = freeFramesBefore - sys_calculate_free_frames();
+	cprintf("%s: %d allocs, %d bytes requested in %d bytes of blocks on %d pages\n",
+			workload, numOfAllocs, requested, allocated, numOfPages);
+	cprintf("	internal waste = %d.%d%%, page-level waste = %d.%d%%\n",
+			(allocated - requested) * 100 / allocated, (allocated - requested) * 1000 / allocated % 10,
+			(numOfPages * PAGE_SIZE - requested) * 100 / (numOfPages * PAGE_SIZE), (numOfPages * PAGE_SIZE - requested) * 1000 / (numOfPages * PAGE_SIZE) % 10);
+	remove_current_mappings(startDA, endDA);
+}
+
+uint32 fragSizes[DYN_ALLOC_MAX_SIZE / DYN_ALLOC_MAX_BLOCK_SIZE];
+void test_dynalloc_fragmentation()
+{
+#if USE_KHEAP
+	panic("test_dynalloc_fragmentation: the kernel heap should be disabled. make sure USE_KHEAP = 0");
+	return;
+#endif
+	cprintf_colored(TEXT_cyan, "\nBlock size classes: %d (DYN_ALLOC_SUBCLASS_BITS = %d)\n", NUM_OF_BLOCK_CLASSES, DYN_ALLOC_SUBCLASS_BITS);
+
+	//Workload 1: one block of each size (the alloc/free tests workload)
+	int n = 0;
+	for (int s = 1; s <= DYN_ALLOC_MAX_BLOCK_SIZE; ++s)
+		fragSizes[n++] = s;
+	report_fragmentation("one block per size", fragSizes, n);
+
+	//Workload 2: uniformly random sizes (fixed seed)
+	uint32 seed = 353;
+	n = 0;
+	for (int i = 0; i < 8000; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		fragSizes[n++] = (seed >> 16) % DYN_ALLOC_MAX_BLOCK_SIZE + 1;
+	}
+	report_fragmentation("random sizes", fragSizes, n);
+}
+
 void test_realloc_block()
 {
 	panic("unseen test");
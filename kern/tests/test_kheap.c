@@ -3,9 +3,11 @@
 #include <inc/memlayout.h>
 #include <inc/queue.h>
 #include <inc/dynamic_allocator.h>
+#include <inc/x86.h>
 #include <kern/cpu/sched.h>
 #include <kern/disk/pagefile_manager.h>
 #include "../mem/kheap.h"
+#include "../mem/kmem_cache.h"
 #include "../mem/memory_manager.h"
 
 
@@ -464,7 +466,8 @@ int initial_page_allocations()
 }
 
 short* startBlockVAs[DYN_ALLOC_MAX_SIZE / DYN_ALLOC_MIN_BLOCK_SIZE] = {0} ;
-#define numOfLevels (LOG2_MAX_SIZE - LOG2_MIN_SIZE + 1)
+#define numOfLevels NUM_OF_BLOCK_CLASSES
+#define NEXT_BLK_SIZE(size) class_to_size(size_to_class(size) + 1)
 int numOfAllocBlocksPerSize[numOfLevels] = {0};
 int numOfAllocPages = 0;
 
@@ -477,6 +480,9 @@ int initial_block_allocations()
 	bool is_correct = 1;
 
 
+	//blocks kfree'd since boot may be parked in the per-CPU magazines
+	kheap_magazines_drain();
+
 	int freeFramesBefore = sys_calculate_free_frames();
 	void *va ;
 	//====================================================================//
@@ -501,6 +507,8 @@ int initial_block_allocations()
 	uint32 currentVA = KERNEL_HEAP_START;
 	int freeFrames = (int)sys_calculate_free_frames() ;
 	int freeDiskFrames = (int)pf_calculate_free_frames() ;
+	//checks are counted per size class and rescaled, since the # of classes depends on DYN_ALLOC_SUBCLASS_BITS
+	int numOfPassedLevels = 0;
 
 	for (int s = 1; s <= DYN_ALLOC_MAX_BLOCK_SIZE; ++s)
 	{
@@ -529,11 +537,11 @@ int initial_block_allocations()
 		}
 		if (s == curSize)
 		{
-			if (is_correct)	eval += 5;
+			if (is_correct)	numOfPassedLevels++;
 
 			//Reinitialize
 			{
-				curSize <<= 1;
+				curSize = NEXT_BLK_SIZE(curSize);
 				curIndex++;
 				currentVA += PAGE_SIZE;
 				numOfAllocPages++;
@@ -547,12 +555,14 @@ int initial_block_allocations()
 			numOfAllocPages++;
 		}
 	}
+	eval += 45 * numOfPassedLevels / numOfLevels;
 
 	//====================================================================//
 	/*3: Check content of each block */
 	cprintf_colored(TEXT_cyan, "	1.3: Check content of each block \n\n") ;
 	curSize = 1<<LOG2_MIN_SIZE ;
 	is_correct = 1;
+	numOfPassedLevels = 0;
 	for (int s = 1; s <= DYN_ALLOC_MAX_BLOCK_SIZE; ++s)
 	{
 		//check the content of the current block
@@ -566,15 +576,16 @@ int initial_block_allocations()
 
 		if (s == curSize)
 		{
-			if (is_correct)	eval += 5;
+			if (is_correct)	numOfPassedLevels++;
 
 			//Reinitialize
 			{
-				curSize <<= 1;
+				curSize = NEXT_BLK_SIZE(curSize);
 				is_correct = 1;
 			}
 		}
 	}
+	eval += 45 * numOfPassedLevels / numOfLevels;
 
 	//====================================================================//
 	/*4: Check number of allocated pages */
@@ -795,7 +806,7 @@ int test_kmalloc_CF_block()
 				expectedPageIndex[i] = 0;
 				prevAllocPages += numOfAllocBlks / expectedNumOfBlksPerPage;
 			}
-			curSize *= 2 ;
+			curSize = NEXT_BLK_SIZE(curSize) ;
 		}
 
 		//Allocate a number of blocks of same size to consume all the remaining free blocks
@@ -1236,7 +1247,7 @@ int test_kfree_CF_block()
 			{
 				//Reinitialize
 				{
-					curSize <<= 1;
+					curSize = NEXT_BLK_SIZE(curSize);
 					idx++ ;
 					maxNumOfBlksAtCurPage = PAGE_SIZE / curSize;
 				}
@@ -1287,7 +1298,7 @@ int test_kfree_CF_block()
 			{
 				//Reinitialize
 				{
-					curSize <<= 1;
+					curSize = NEXT_BLK_SIZE(curSize);
 					idx++ ;
 				}
 				continue;
@@ -1336,7 +1347,7 @@ int test_kfree_CF_block()
 			if (s == curSize)
 			{
 				//Reinitialize
-				curSize <<= 1;
+				curSize = NEXT_BLK_SIZE(curSize);
 				idx++ ;
 				maxNumOfBlksAtCurPage = PAGE_SIZE / curSize;
 				expectedNumOfRemovedPages++;
@@ -1383,7 +1394,7 @@ int test_kfree_CF_block()
 			if (s == curSize)
 			{
 				//Reinitialize
-				curSize <<= 1;
+				curSize = NEXT_BLK_SIZE(curSize);
 				idx++ ;
 			}
 
@@ -1428,7 +1439,7 @@ int test_kfree_CF_block()
 
 			if (s == curSize)
 			{
-				curSize <<= 1;
+				curSize = NEXT_BLK_SIZE(curSize);
 				idx++ ;
 			}
 		}
@@ -2078,25 +2089,114 @@ int test_kheap_virt_addr()
 /**********************************************************************************************/
 /********************************** KREALLOC TESTING AREA *************************************/
 /**********************************************************************************************/
+static void fill_pages(char *ptr, int numOfPages, char base)
+{
+	for (int p = 0; p < numOfPages; ++p)
+		memset(ptr + p*PAGE_SIZE, base + p, PAGE_SIZE);
+}
+static bool check_pages(char *ptr, int numOfPages, char base)
+{
+	for (int p = 0; p < numOfPages; ++p)
+		if (ptr[p*PAGE_SIZE] != (char)(base + p) || ptr[p*PAGE_SIZE + PAGE_SIZE - 1] != (char)(base + p))
+			return 0;
+	return 1;
+}
+
+//Shrink, grow in place (free neighbor & break) and grow by moving the frames (no extra frames except the new pages)
+static int test_krealloc_page_scenario()
+{
+	cprintf_colored(TEXT_yellow,"==============================================\n");
+	cprintf_colored(TEXT_yellow,"MAKE SURE to have a FRESH RUN for this test\n(i.e. don't run any program/test before it)\n");
+	cprintf_colored(TEXT_yellow,"==============================================\n");
+
+	int eval = 0;
+	bool correct = 1;
+	uint32 strategy = get_kheap_strategy();
+	int initFreeFrames = (int)sys_calculate_free_frames() ;
+	uint32 initBreak = kheapPageAllocBreak;
+	int freeFrames;
+	char *p, *q, *ptr;
+
+	//allocate at the break to have a known layout: p = 6 pages, q = 1 page
+	set_kheap_strategy(KHP_PLACE_CONTALLOC);
+	p = kmalloc(6*PAGE_SIZE);
+	q = kmalloc(1*PAGE_SIZE);
+	fill_pages(p, 6, 'a');
+	fill_pages(q, 1, 'z');
+
+	cprintf_colored(TEXT_cyan,"\n1. Shrink by unmapping the tail pages [20%]\n");
+	freeFrames = (int)sys_calculate_free_frames() ;
+	ptr = krealloc(p, 2*PAGE_SIZE);
+	if (ptr != p) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"1.1 shrink should not move the allocation. Expected = %x, Actual = %x\n", p, ptr); }
+	if ((int)sys_calculate_free_frames() - freeFrames != 4) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"1.2 wrong number of freed frames. Expected = 4, Actual = %d\n", (int)sys_calculate_free_frames() - freeFrames); }
+	if (!check_pages(p, 2, 'a')) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"1.3 content is changed\n"); }
+	if (correct) eval += 20;
+	correct = 1;
+
+	cprintf_colored(TEXT_cyan,"\n2. Grow in place into the adjacent free extent [20%]\n");
+	freeFrames = (int)sys_calculate_free_frames() ;
+	ptr = krealloc(p, 5*PAGE_SIZE);
+	if (ptr != p) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"2.1 should grow in place. Expected = %x, Actual = %x\n", p, ptr); }
+	if (freeFrames - (int)sys_calculate_free_frames() != 3) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"2.2 wrong number of allocated frames. Expected = 3, Actual = %d\n", freeFrames - (int)sys_calculate_free_frames()); }
+	if (!check_pages(p, 2, 'a')) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"2.3 content is changed\n"); }
+	if (correct) eval += 20;
+	correct = 1;
+
+	cprintf_colored(TEXT_cyan,"\n3. Grow in place at the break [20%]\n");
+	freeFrames = (int)sys_calculate_free_frames() ;
+	ptr = krealloc(q, 3*PAGE_SIZE);
+	if (ptr != q) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"3.1 should grow in place. Expected = %x, Actual = %x\n", q, ptr); }
+	if (freeFrames - (int)sys_calculate_free_frames() != 2) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"3.2 wrong number of allocated frames. Expected = 2, Actual = %d\n", freeFrames - (int)sys_calculate_free_frames()); }
+	if (kheapPageAllocBreak != (uint32)q + 3*PAGE_SIZE) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"3.3 wrong BREAK. Expected = %x, Actual = %x\n", (uint32)q + 3*PAGE_SIZE, kheapPageAllocBreak); }
+	if (!check_pages(q, 1, 'z')) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"3.4 content is changed\n"); }
+	if (correct) eval += 20;
+	correct = 1;
+
+	cprintf_colored(TEXT_cyan,"\n4. Grow by moving the frames (no copy) [20%]\n");
+	freeFrames = (int)sys_calculate_free_frames() ;
+	ptr = krealloc(p, 8*PAGE_SIZE);
+	if (ptr == NULL || ptr == p) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"4.1 should be moved. Old = %x, New = %x\n", p, ptr); }
+	else
+	{
+		if (freeFrames - (int)sys_calculate_free_frames() != 3) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"4.2 only the extra pages should take new frames. Expected = 3, Actual = %d\n", freeFrames - (int)sys_calculate_free_frames()); }
+		if (!check_pages(ptr, 2, 'a')) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"4.3 content is not moved correctly\n"); }
+		if (kheap_physical_address((uint32)p) != 0) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"4.4 old pages are still mapped\n"); }
+		p = ptr;
+	}
+	if (correct) eval += 20;
+	correct = 1;
+
+	cprintf_colored(TEXT_cyan,"\n5. Free all [20%]\n");
+	kfree(p);
+	kfree(q);
+	if ((int)sys_calculate_free_frames() != initFreeFrames) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"5.1 frames are not returned. Expected = %d, Actual = %d\n", initFreeFrames, sys_calculate_free_frames()); }
+	if (kheapPageAllocBreak != initBreak) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"5.2 BREAK is not restored. Expected = %x, Actual = %x\n", initBreak, kheapPageAllocBreak); }
+	if (correct) eval += 20;
+
+	set_kheap_strategy(strategy);
+	cprintf_colored(TEXT_light_green,"\nTest krealloc Page Alloc Completed. Evaluation = %d%\n", eval);
+	return 0;
+}
+
 int test_krealloc_FF_page()
 {
-	panic("not implemented function");
+	return test_krealloc_page_scenario();
 }
 int test_krealloc_NF_page()
 {
-	panic("not implemented function");
+	return test_krealloc_page_scenario();
 }
 int test_krealloc_BF_page()
 {
-	panic("not implemented function");
+	return test_krealloc_page_scenario();
 }
 int test_krealloc_WF_page()
 {
-	panic("not implemented function");
+	return test_krealloc_page_scenario();
 }
 int test_krealloc_CF_page()
 {
-	panic("not implemented function");
+	return test_krealloc_page_scenario();
 }
 
 int test_krealloc_FF_block()
@@ -2144,25 +2244,165 @@ int test_krealloc_CF_both()
 /**********************************************************************************************/
 /*************************** FAST PAGE ALLOCATOR TESTING AREA *********************************/
 /**********************************************************************************************/
+#define FAST_SMALL_NUM_OF_ALLOCS 	64
+#define FAST_LARGE_NUM_OF_ALLOCS 	1024
+#define FAST_MAX_COST_RATIO 		3
+
+//Allocate "numOfAllocs" single pages, then free half of them (the odd ones, from the end)
+//while measuring the cost of each kfree. Returns the average cycles per kfree.
+static uint32 fast_kfree_avg_cost(int numOfAllocs)
+{
+	for (int i = 0; i < numOfAllocs; ++i)
+	{
+		ptr_fast_allocations[i] = kmalloc(PAGE_SIZE);
+		if (ptr_fast_allocations[i] == NULL)
+			panic("fast: kmalloc #%d failed while it is expected to succeed", i);
+		*((int*)ptr_fast_allocations[i]) = i;
+	}
+	uint64 totalCycles = 0;
+	uint32 numOfFrees = 0;
+	int i = (numOfAllocs % 2 == 0) ? numOfAllocs - 1 : numOfAllocs - 2;
+	for (; i > 0; i -= 2)
+	{
+		uint64 t1 = read_tsc();
+		kfree(ptr_fast_allocations[i]);
+		uint64 t2 = read_tsc();
+		totalCycles += t2 - t1;
+		numOfFrees++;
+	}
+	for (i = 0; i < numOfAllocs; i += 2)
+	{
+		if (*((int*)ptr_fast_allocations[i]) != i)
+			panic("fast: content of allocation #%d is corrupted", i);
+		kfree(ptr_fast_allocations[i]);
+	}
+	return (uint32)(totalCycles / numOfFrees);
+}
+
+//kfree must locate its allocation in O(1): its cost should stay flat as the number of live allocations grows
+static int test_fast_kfree_cost()
+{
+	cprintf_colored(TEXT_yellow,"==============================================\n");
+	cprintf_colored(TEXT_yellow,"MAKE SURE to have a FRESH RUN for this test\n(i.e. don't run any program/test before it)\n");
+	cprintf_colored(TEXT_yellow,"==============================================\n");
+
+	int eval = 0;
+	bool correct = 1;
+	int freeFrames = (int)sys_calculate_free_frames() ;
+	int freeDiskFrames = (int)pf_calculate_free_frames() ;
+	uint32 breakBefore = kheapPageAllocBreak;
+	uint32 nodesBefore = kheapNodesInUse;
+
+	//warm up (page tables of the page allocator, ...etc)
+	fast_kfree_avg_cost(FAST_SMALL_NUM_OF_ALLOCS);
+
+	cprintf_colored(TEXT_cyan,"\n1. Measure kfree cost with %d & %d live allocations [60%]\n", FAST_SMALL_NUM_OF_ALLOCS, FAST_LARGE_NUM_OF_ALLOCS);
+	uint32 smallCost = fast_kfree_avg_cost(FAST_SMALL_NUM_OF_ALLOCS);
+	uint32 largeCost = fast_kfree_avg_cost(FAST_LARGE_NUM_OF_ALLOCS);
+	cprintf("	avg kfree cycles: %d live allocs = %d, %d live allocs = %d\n", FAST_SMALL_NUM_OF_ALLOCS, smallCost, FAST_LARGE_NUM_OF_ALLOCS, largeCost);
+	if (largeCost > FAST_MAX_COST_RATIO * smallCost) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"kfree cost grows with the number of live allocations (x%d)\n", largeCost / (smallCost ? smallCost : 1)); }
+	if (correct) eval += 60;
+	correct = 1;
+
+	cprintf_colored(TEXT_cyan,"\n2. Check freed frames, BREAK & metadata nodes [40%]\n");
+	if ((freeDiskFrames - pf_calculate_free_frames()) != 0) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"Page file is changed while it's not expected to.\n"); }
+	if ((int)sys_calculate_free_frames() < freeFrames) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"Wrong kfree: pages in memory are not freed correctly. Expected >= %d, Actual = %d\n", freeFrames, sys_calculate_free_frames()); }
+	if (kheapPageAllocBreak != breakBefore) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"BREAK is not restored after freeing everything! Expected = %x, Actual = %x\n", breakBefore, kheapPageAllocBreak); }
+	if (kheapNodesInUse != nodesBefore) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"Metadata nodes are not returned to the pool! Expected = %d, Actual = %d\n", nodesBefore, kheapNodesInUse); }
+	if (correct) eval += 40;
+
+	cprintf_colored(TEXT_light_green,"\nTest fast kfree Completed. Evaluation = %d%\n", eval);
+	return 0;
+}
+
 int test_fast_FF()
 {
-	panic("not implemented function");
+	return test_fast_kfree_cost();
 }
 int test_fast_NF()
 {
-	panic("not implemented function");
+	return test_fast_kfree_cost();
 }
 int test_fast_BF()
 {
-	panic("not implemented function");
+	return test_fast_kfree_cost();
 }
 int test_fast_WF()
 {
-	panic("not implemented function");
+	return test_fast_kfree_cost();
 }
 int test_fast_CF()
 {
-	panic("not implemented function");
+	return test_fast_kfree_cost();
+}
+
+//Object caches: objects come constructed, slabs are carved one page at a time
+//and freed objects stay warm (reused LIFO without touching the kernel heap)
+#define KCACHE_TST_OBJ_SIZE 	40
+#define KCACHE_TST_MAGIC 		0x0BADCAFE
+static void kcache_tst_ctor(void *obj)
+{
+	*((uint32*)obj) = KCACHE_TST_MAGIC;
+}
+int test_kmem_cache()
+{
+	static struct kmem_cache *tstCache = NULL;
+	if (tstCache == NULL)
+		tstCache = kmem_cache_create("test objs", KCACHE_TST_OBJ_SIZE, kcache_tst_ctor);
+
+	int eval = 0;
+	bool correct = 1;
+	//warm objects left by a previous run are used first, then exactly one more slab is needed
+	uint32 numOfObjs = tstCache->num_free + tstCache->objs_per_slab + 1;
+	void **objs = kmalloc(numOfObjs * sizeof(void*));
+	if (objs == NULL)
+		panic("kcache: can't allocate the test array");
+
+	cprintf_colored(TEXT_cyan,"\n1. Allocate objects across slab boundaries [40%]\n");
+	uint32 warm = tstCache->num_free;
+	uint32 slabsBefore = tstCache->num_slabs;
+	int freeFrames = (int)sys_calculate_free_frames() ;
+	for (int i = 0; i < numOfObjs; i++)
+	{
+		objs[i] = kmem_cache_alloc(tstCache);
+		if (objs[i] == NULL) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"kmem_cache_alloc #%d failed\n", i); break; }
+		if ((uint32)objs[i] < KERNEL_HEAP_START || (uint32)objs[i] + KCACHE_TST_OBJ_SIZE > KERNEL_HEAP_MAX) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"object #%d is outside the kernel heap [%x]\n", i, objs[i]); break; }
+		if (*((uint32*)objs[i]) != KCACHE_TST_MAGIC) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"object #%d is not constructed\n", i); break; }
+		memset((char*)objs[i] + sizeof(uint32), i & 0xFF, KCACHE_TST_OBJ_SIZE - sizeof(uint32));
+	}
+	for (int i = 0; correct && i < numOfObjs; i++)
+	{
+		for (int j = sizeof(uint32); j < KCACHE_TST_OBJ_SIZE; j++)
+			if (((uint8*)objs[i])[j] != (i & 0xFF)) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"object #%d overlaps another object\n", i); break; }
+	}
+	uint32 newSlabs = tstCache->num_slabs - slabsBefore;
+	uint32 expectedSlabs = ROUNDUP(numOfObjs - warm, tstCache->objs_per_slab) / tstCache->objs_per_slab;
+	if (newSlabs != expectedSlabs) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"Wrong # of slabs carved. Expected = %d, Actual = %d\n", expectedSlabs, newSlabs); }
+	if (freeFrames - (int)sys_calculate_free_frames() < newSlabs) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"Slabs are not backed by frames. Expected >= %d, Actual = %d\n", newSlabs, freeFrames - (int)sys_calculate_free_frames()); }
+	if (correct) eval += 40;
+	correct = 1;
+
+	cprintf_colored(TEXT_cyan,"\n2. Free objects & reallocate them warm (LIFO, no new slabs/frames) [60%]\n");
+	for (int i = 0; i < numOfObjs; i++)
+		kmem_cache_free(tstCache, objs[i]);
+	if (tstCache->num_free != tstCache->num_objs) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"Objects are not returned to the cache\n"); }
+	freeFrames = (int)sys_calculate_free_frames() ;
+	slabsBefore = tstCache->num_slabs;
+	for (int i = numOfObjs - 1; i >= 0; i--)
+	{
+		void *obj = kmem_cache_alloc(tstCache);
+		if (obj != objs[i]) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"object #%d is not reused LIFO. Expected = %x, Actual = %x\n", i, objs[i], obj); break; }
+		if (*((uint32*)obj) != KCACHE_TST_MAGIC) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"reused object #%d lost its constructed state\n", i); break; }
+	}
+	if (tstCache->num_slabs != slabsBefore) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"new slabs are carved while warm objects exist\n"); }
+	if ((int)sys_calculate_free_frames() != freeFrames) { correct = 0; cprintf_colored(TEXT_TESTERR_CLR,"frames are allocated while warm objects exist\n"); }
+	for (int i = 0; i < numOfObjs; i++)
+		kmem_cache_free(tstCache, objs[i]);
+	kfree(objs);
+	if (correct) eval += 60;
+
+	cprintf_colored(TEXT_light_green,"\nTest object caches Completed. Evaluation = %d%\n", eval);
+	return 0;
 }
 
 
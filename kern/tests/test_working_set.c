@@ -8,6 +8,9 @@
 #include <kern/tests/test_working_set.h>
 #include <kern/proc/user_environment.h>
 #include <kern/mem/working_set_manager.h>
+#include <kern/mem/boot_memory_manager.h>
+#include <kern/mem/memory_manager.h>
+#include <kern/mem/kheap.h>
 #include <kern/cpu/cpu.h>
 #include <kern/cpu/kclock.h>
 
@@ -260,3 +263,100 @@ int sys_check_WS_list(uint32* WS_list_content, int actual_WS_list_size, uint32 l
 	return 0;
 #endif
 }
+
+//=====================================
+// LRU AGING vs. A REFERENCE:
+//=====================================
+//Fill the WS of a temp. env with more pages than a quantum slice (mapped in the loaded directory)
+//and, before each aging step, set the used bits of a pseudo-random subset of its pages: a few hot
+//pages are used at most steps, the others rarely. The aging must give the time stamps, and thus
+//the LRU victims, of a reference aging computed aside from the same used bits
+#define LRU_AGING_TST_VA				0x80000000
+#define LRU_AGING_TST_NUM_OF_PAGES		64
+#define LRU_AGING_TST_NUM_OF_HOT_PAGES	8
+#define LRU_AGING_TST_NUM_OF_STEPS		300
+int test_lru_aging()
+{
+#if USE_KHEAP
+	struct Env* env = kmalloc(sizeof(struct Env));
+	if (env == NULL)
+		panic("test_lru_aging: can't allocate the temp. env");
+	memset(env, 0, sizeof(struct Env));
+	env->env_page_directory = ptr_page_directory;
+	env->page_WS_max_size = LRU_AGING_TST_NUM_OF_PAGES;
+	LIST_INIT(&(env->page_WS_list));
+
+	uint32 ref_time_stamps[LRU_AGING_TST_NUM_OF_PAGES];
+	for (int p = 0; p < LRU_AGING_TST_NUM_OF_PAGES; p++)
+	{
+		struct FrameInfo *ptr_frame_info;
+		allocate_frame(&ptr_frame_info);
+		map_frame(ptr_page_directory, ptr_frame_info, LRU_AGING_TST_VA + p * PAGE_SIZE, PERM_WRITEABLE);
+		LIST_INSERT_TAIL(&(env->page_WS_list), env_page_ws_list_create_element(env, LRU_AGING_TST_VA + p * PAGE_SIZE));
+		ref_time_stamps[p] = 0;
+	}
+	uint32 *ptr_page_table = NULL;
+	get_page_table(ptr_page_directory, LRU_AGING_TST_VA, &ptr_page_table);
+
+	bool correct = 1;
+	uint32 seed = 1;
+	for (int step = 1; step <= LRU_AGING_TST_NUM_OF_STEPS && correct; step++)
+	{
+		for (int p = 0; p < LRU_AGING_TST_NUM_OF_PAGES; p++)
+		{
+			seed = seed * 1103515245 + 12345;
+			uint32 r = (seed >> 16) % 100;
+			bool used = (p < LRU_AGING_TST_NUM_OF_HOT_PAGES) ? (r < 70) : (r < 5);
+			if (used)
+				ptr_page_table[PTX(LRU_AGING_TST_VA + p * PAGE_SIZE)] |= PERM_USED;
+			ref_time_stamps[p] = (ref_time_stamps[p] >> 1) | (used ? 0x80000000 : 0);
+		}
+		env_page_ws_age_step(env);
+
+		if (step % 7 != 0)
+			continue;
+		int expected = 0;
+		for (int p = 1; p < LRU_AGING_TST_NUM_OF_PAGES; p++)
+		{
+			if (ref_time_stamps[p] < ref_time_stamps[expected])
+				expected = p;
+		}
+		struct WorkingSetElement *victim = env_page_ws_lru_select_victim(env);
+		if (victim->virtual_address != LRU_AGING_TST_VA + expected * PAGE_SIZE)
+		{
+			cprintf("step %d: WRONG victim! Actual = %x Expected = %x\n", step, victim->virtual_address, LRU_AGING_TST_VA + expected * PAGE_SIZE);
+			correct = 0;
+		}
+		int p = 0;
+		struct WorkingSetElement *wse;
+		LIST_FOREACH(wse, &(env->page_WS_list))
+		{
+			if (wse->time_stamp != ref_time_stamps[p])
+			{
+				cprintf("step %d: WRONG time stamp of page %x! Actual = %x Expected = %x\n", step, wse->virtual_address, wse->time_stamp, ref_time_stamps[p]);
+				correct = 0;
+				break;
+			}
+			p++;
+		}
+	}
+
+	struct WorkingSetElement *wse;
+	while ((wse = LIST_FIRST(&(env->page_WS_list))) != NULL)
+	{
+		LIST_REMOVE(&(env->page_WS_list), wse);
+		env_page_ws_free_element(env, wse);
+	}
+	for (int p = 0; p < LRU_AGING_TST_NUM_OF_PAGES; p++)
+		unmap_frame(ptr_page_directory, LRU_AGING_TST_VA + p * PAGE_SIZE);
+	del_page_table(ptr_page_directory, LRU_AGING_TST_VA);
+	kfree(env);
+
+	if (!correct)
+		panic("[EVAL] the LRU aging doesn't match the reference aging.\n");
+	cprintf("Congratulations!! test of the LRU aging (WS of %d pages) completed successfully.\n", LRU_AGING_TST_NUM_OF_PAGES);
+#else
+	panic("test_lru_aging: this function is intended to be used when USE_KHEAP = 1");
+#endif
+	return 0;
+}
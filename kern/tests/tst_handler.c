@@ -19,6 +19,7 @@
 #include "../tests/test_commands.h"
 #include "../tests/test_dynamic_allocator.h"
 #include "../tests/test_scheduler.h"
+#include "../tests/test_working_set.h"
 
 struct Test tests[] = {
 		{"3functions", "Env Load: test the creation of new dir, tables and pages WS", tst_three_creation_functions},
@@ -39,6 +40,7 @@ struct Test tests[] = {
 		{"pg", "Test paging manipulation for a specific page", tst_paging_manipulation},
 		{"chunks","Test chunk manipulations", tst_chunks },
 		{"kheap", "Test KHEAP functions", tst_kheap},
+		{"lruaging", "Test the time stamps & victims of the LRU aging against a reference", tst_lru_aging},
 
 };
 
@@ -220,6 +222,18 @@ int tst_str2lower(int number_of_arguments, char **arguments)
 	return 0;
 }
 
+int tst_lru_aging(int number_of_arguments, char **arguments)
+{
+	if (number_of_arguments != 1)
+	{
+		cprintf("Invalid number of arguments! USAGE: tst lruaging\n");
+		return 0;
+	}
+
+	test_lru_aging();
+	return 0;
+}
+
 int tst_autocomplete(int number_of_arguments, char **arguments)
 {
 	int x = TestAutoCompleteCommand();
@@ -265,6 +279,11 @@ int tst_dyn_alloc(int number_of_arguments, char **arguments)
 	{
 		test_free_block();
 	}
+	// Report fragmentation of the size classes: tst dynalloc frag
+	else if(strcmp(arguments[1], "frag") == 0)
+	{
+		test_dynalloc_fragmentation();
+	}
 	/*	// Test 5 Example for free_block: tstdynalloc freeFF
 	else if(strcmp(arguments[1], "freeff") == 0)
 	{
@@ -365,6 +384,11 @@ int tst_paging_manipulation(int number_of_arguments, char **arguments)
 	{
 		test_virtual_to_physical();
 	}
+	// Test 5-Benchmark TLB refresh after a fault (full flush vs. invlpg): tst pg tlb
+	else if(strcmp(arguments[1], "tlb") == 0)
+	{
+		test_tlb_invalidation_cost();
+	}
 	return 0;
 }
 
@@ -400,6 +424,11 @@ int tst_kheap(int number_of_arguments, char **arguments)
 		cprintf("Invalid number of arguments! USAGE: tst kheap <Strategy> kphysaddr\n") ;
 		return 0;
 	}
+	else if (strcmp(arguments[2], "kcache") == 0 && number_of_arguments != 3)
+	{
+		cprintf("Invalid number of arguments! USAGE: tst kheap <Strategy> kcache\n") ;
+		return 0;
+	}
 	else if (strcmp(arguments[2], "krealloc") == 0 && number_of_arguments != 4)
 	{
 		cprintf("Invalid number of arguments! USAGE: tst kheap <Strategy> krealloc <both or blk or page>\n") ;
@@ -493,7 +522,13 @@ int tst_kheap(int number_of_arguments, char **arguments)
 		test_krealloc(testType);
 		return 0;
 	}
-	/*	// Test 6-sbr: tst kheap FF sbrk
+	// Test 6-kcache: tst kheap <Strategy> kcache
+	else if(strcmp(arguments[2], "kcache") == 0)
+	{
+		test_kmem_cache();
+		return 0;
+	}
+	/*	// Test 7-sbr: tst kheap FF sbrk
 	else if (strcmp(arguments[2], "sbrk") == 0)
 	{
 		test_ksbrk();
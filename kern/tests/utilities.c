@@ -461,26 +461,32 @@ void sys_utilities(char* utilityName, int value)
 		int numOfRefs = strtol(tokens[1], NULL, 10);
 		assert(numOfRefs < MAX_REF_CNT);
 		struct Env* env = get_cpu_proc() ;
-		if (numOfRefs != LIST_SIZE(&(env->referenceStreamList)))
+		if (numOfRefs != env->referenceStream.num_refs)
 		{
-			cprintf("num of references MISMATCHED! Expected = %d, Actual = %d\n", numOfRefs, LIST_SIZE(&(env->referenceStreamList)));
+			cprintf("num of references MISMATCHED! Expected = %d, Actual = %d\n", numOfRefs, env->referenceStream.num_refs);
 			*correct = 0;
 			return;
 		}
 
 		uint32 *expectedRefStream = (uint32 *)strtol(tokens[2], NULL, 10);
 
-		//Check the expected reference stream against the calculated one
-		struct PageRefElement *curRef = LIST_FIRST(&(env->referenceStreamList));
+		//Check the expected reference stream against the calculated one (runs are expanded)
+		struct PageRefRun *curRun = env->referenceStream.runs;
+		uint32 curRunRef = 0;
 		for (int i = 0; i < numOfRefs; ++i)
 		{
-			if (ROUNDDOWN(expectedRefStream[i], PAGE_SIZE) != ROUNDDOWN(curRef->virtual_address, PAGE_SIZE))
+			uint32 curRefVA = curRun->page_number << PGSHIFT;
+			if (ROUNDDOWN(expectedRefStream[i], PAGE_SIZE) != curRefVA)
 			{
-				cprintf("Ref#%d MISMATCHED! Expected = %d, Actual = %d\n", ROUNDDOWN(expectedRefStream[i], PAGE_SIZE), ROUNDDOWN(curRef->virtual_address, PAGE_SIZE));
+				cprintf("Ref#%d MISMATCHED! Expected = %d, Actual = %d\n", ROUNDDOWN(expectedRefStream[i], PAGE_SIZE), curRefVA);
 				*correct = 0;
 				return;
 			}
-			curRef = LIST_NEXT(curRef);
+			if (++curRunRef == curRun->count)
+			{
+				curRun++;
+				curRunRef = 0;
+			}
 		}
 	}
 	else if (strcmp(utilityName, "__InvPage__") == 0)
@@ -616,7 +622,7 @@ void scarce_memory()
 	int fflSize = 0;
 	acquire_kspinlock(&MemFrameLists.mfllock);
 	{
-		fflSize = LIST_SIZE(&MemFrameLists.free_frame_list);
+		fflSize = count_free_frames();
 
 		uint32 size_of_already_allocated = number_of_frames - fflSize ;
 		uint32 size_tobe_allocated = total_size_tobe_allocated - size_of_already_allocated;
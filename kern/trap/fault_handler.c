@@ -55,6 +55,359 @@ uint8 isBufferingEnabled(){  return _EnableBuffering ; }
 void setModifiedBufferLength(uint32 length) { _ModifiedBufferLength = length;}
 uint32 getModifiedBufferLength() { return _ModifiedBufferLength;}
 
+//===============================
+// FAULT-AROUND (PREPAGING)
+//===============================
+//Max # of neighbour pages paged in with a faulted one (0: disabled). The run is read by a single
+//disk command, together with the faulted page
+void setFaultAroundWindow(uint32 num_of_pages)
+{
+	_FaultAroundWindow = MIN(num_of_pages, PAGE_FILE_MAX_CLUSTER_PAGES - 1);
+}
+uint32 getFaultAroundWindow() { return _FaultAroundWindow;}
+
+//A buffered page keeps its frame # in its PTE with PRESENT = 0 and BUFFERED = 1, while its frame
+//(isBuffered, proc, va) waits on the modified list if the PTE is MODIFIED, else on the free list.
+//Frames are taken back in FIFO order: by a refault of their page (page_buffer_reclaim) or else,
+//from the free list only, by allocate_frame() which clears the PTE.
+
+//Write-back of the modified list: by batches of up to MODIFIED_FLUSH_BATCH frames sorted by their
+//disk frame #, so that each run of consecutive disk frames is copied to the staging buffer then
+//written by a single disk command (one flush at a time)
+#define MODIFIED_FLUSH_BATCH 256
+struct modified_flush_entry
+{
+	struct FrameInfo *ptr_frame_info;
+	struct Env *env;
+	uint32 va;
+	uint32 dfn;
+};
+static struct modified_flush_entry modified_flush_batch[MODIFIED_FLUSH_BATCH];
+static uint8 modified_flush_staging[PAGE_FILE_MAX_CLUSTER_PAGES * PAGE_SIZE];
+static bool modified_flush_in_progress = 0;
+
+//Write back the frames that are on the modified list, then move them to the free list (still
+//buffered). The frames of a batch are marked by isBuffered = 2 while they're being written:
+//a frame reclaimed (isBuffered = 0) meanwhile is skipped and stays where it is. The mark keeps
+//a frame in place, so its copy to the staging buffer is done outside mfllock.
+void page_buffer_flush_modified()
+{
+	uint32 num_to_flush;
+	acquire_kspinlock(&MemFrameLists.mfllock);
+	{
+		num_to_flush = modified_flush_in_progress ? 0 : LIST_SIZE(&MemFrameLists.modified_frame_list);
+		if (num_to_flush > 0)
+			modified_flush_in_progress = 1;
+	}
+	release_kspinlock(&MemFrameLists.mfllock);
+
+	while (num_to_flush > 0)
+	{
+		//1. Take the next batch from the head of the list
+		uint32 n = 0;
+		acquire_kspinlock(&MemFrameLists.mfllock);
+		{
+			struct FrameInfo *ptr_frame_info = LIST_FIRST(&MemFrameLists.modified_frame_list);
+			for (; ptr_frame_info != NULL && n < num_to_flush && n < MODIFIED_FLUSH_BATCH; n++)
+			{
+				ptr_frame_info->isBuffered = 2;
+				modified_flush_batch[n].ptr_frame_info = ptr_frame_info;
+				modified_flush_batch[n].env = ptr_frame_info->proc;
+				modified_flush_batch[n].va = ptr_frame_info->va;
+				ptr_frame_info = LIST_NEXT(ptr_frame_info);
+			}
+		}
+		release_kspinlock(&MemFrameLists.mfllock);
+		if (n == 0)
+			break;
+		num_to_flush -= n;
+
+		//2. Drop the frames reclaimed meanwhile, get the disk frames of the others (new heap/stack
+		//pages are added to the page file) and sort by them
+		uint32 m = 0;
+		for (uint32 i = 0; i < n; i++)
+		{
+			bool still_flushed;
+			acquire_kspinlock(&MemFrameLists.mfllock);
+			{
+				still_flushed = (modified_flush_batch[i].ptr_frame_info->isBuffered == 2);
+			}
+			release_kspinlock(&MemFrameLists.mfllock);
+			if (!still_flushed)
+				continue;
+
+			struct modified_flush_entry entry = modified_flush_batch[i];
+			entry.dfn = pf_get_env_page_dfn_to_update(entry.env, entry.va);
+			int j = m - 1;
+			for (; j >= 0 && modified_flush_batch[j].dfn > entry.dfn; j--)
+				modified_flush_batch[j + 1] = modified_flush_batch[j];
+			modified_flush_batch[j + 1] = entry;
+			m++;
+		}
+		n = m;
+
+		//3. Write each run of consecutive disk frames (still being written) by one command
+		for (uint32 i = 0; i < n; )
+		{
+			uint32 run = 0;
+			acquire_kspinlock(&MemFrameLists.mfllock);
+			{
+				while (i + run < n && run < PAGE_FILE_MAX_CLUSTER_PAGES &&
+						modified_flush_batch[i + run].dfn == modified_flush_batch[i].dfn + run &&
+						modified_flush_batch[i + run].ptr_frame_info->isBuffered == 2)
+					run++;
+			}
+			release_kspinlock(&MemFrameLists.mfllock);
+			if (run == 0)
+			{
+				i++;	//reclaimed
+				continue;
+			}
+
+			for (uint32 k = 0; k < run; k++)
+				read_frame(modified_flush_batch[i + k].ptr_frame_info, modified_flush_staging + k * PAGE_SIZE);
+
+			write_disk_pages(modified_flush_batch[i].dfn, modified_flush_staging, run);
+
+			acquire_kspinlock(&MemFrameLists.mfllock);
+			{
+				for (uint32 k = i; k < i + run; k++)
+				{
+					struct FrameInfo *ptr_frame_info = modified_flush_batch[k].ptr_frame_info;
+					if (ptr_frame_info->isBuffered != 2)
+						continue;
+					modified_flush_batch[k].env->nPageOut++;
+					LIST_REMOVE(&MemFrameLists.modified_frame_list, ptr_frame_info);
+					ptr_frame_info->isBuffered = 1;
+					pt_set_page_permissions(modified_flush_batch[k].env->env_page_directory, modified_flush_batch[k].va, 0, PERM_MODIFIED);
+					LIST_INSERT_TAIL(&MemFrameLists.free_frame_list, ptr_frame_info);
+					MemFrameLists.num_free_buffered++;
+				}
+			}
+			release_kspinlock(&MemFrameLists.mfllock);
+			i += run;
+		}
+	}
+
+	acquire_kspinlock(&MemFrameLists.mfllock);
+	{
+		modified_flush_in_progress = 0;
+	}
+	release_kspinlock(&MemFrameLists.mfllock);
+}
+
+//Take the page at 'va' out of the memory of 'env' that must be the loaded one (its WS element
+//is removed or recycled by the caller):
+//	with buffering, its frame is kept intact on the modified list if it's dirty (and the modified
+//	buffer is enabled) or on the free list otherwise, so that a refault can reclaim it.
+//	Without buffering (or if the frame is shared), it's written back if it's dirty, then unmapped.
+void page_out_victim(struct Env* env, uint32 va)
+{
+	va = ROUNDDOWN(va, PAGE_SIZE);
+	uint32 *ptr_page_table;
+	struct FrameInfo *ptr_frame_info = get_frame_info(env->env_page_directory, va, &ptr_page_table);
+	assert(ptr_frame_info != NULL);
+	bool modified = (ptr_page_table[PTX(va)] & PERM_MODIFIED) == PERM_MODIFIED;
+	if (modified)
+		env->nModifiedPages++;
+	else
+		env->nNotModifiedPages++;
+
+	if (!isBufferingEnabled() || ptr_frame_info->references > 1)
+	{
+		if (modified)
+			pf_update_env_page(env, va, ptr_frame_info);
+		unmap_frame(env->env_page_directory, va);
+		return;
+	}
+	if (modified && !isModifiedBufferEnabled())
+	{
+		pf_update_env_page(env, va, ptr_frame_info);	//clears PERM_MODIFIED
+		modified = 0;
+	}
+
+	bool flush = 0;
+	acquire_kspinlock(&MemFrameLists.mfllock);
+	{
+		ptr_frame_info->references = 0;
+		ptr_frame_info->isBuffered = 1;
+		ptr_frame_info->proc = env;
+		ptr_frame_info->va = va;
+		pt_set_page_permissions(env->env_page_directory, va, PERM_BUFFERED, PERM_PRESENT);
+		if (modified)
+		{
+			LIST_INSERT_TAIL(&MemFrameLists.modified_frame_list, ptr_frame_info);
+			flush = LIST_SIZE(&MemFrameLists.modified_frame_list) >= getModifiedBufferLength();
+		}
+		else
+		{
+			LIST_INSERT_TAIL(&MemFrameLists.free_frame_list, ptr_frame_info);
+			MemFrameLists.num_free_buffered++;
+		}
+	}
+	release_kspinlock(&MemFrameLists.mfllock);
+
+	if (flush)
+		page_buffer_flush_modified();
+}
+
+//Soft fault: if the page at 'va' of 'env' is still buffered, take its frame back from the free
+//or modified list and map it again with its content (no page-in).
+//Return its frame, NULL if the page isn't buffered
+static struct FrameInfo* page_buffer_reclaim(struct Env* env, uint32 va)
+{
+	uint32 *ptr_page_table;
+	get_page_table(env->env_page_directory, va, &ptr_page_table);
+	if (ptr_page_table == NULL)
+		return NULL;
+	struct FrameInfo *ptr_frame_info = NULL;
+	acquire_kspinlock(&MemFrameLists.mfllock);
+	{
+		//checked under the lock since allocate_frame() clears the PTE when it reuses the frame
+		uint32 page_table_entry = ptr_page_table[PTX(va)];
+		if (page_table_entry & PERM_BUFFERED)
+		{
+			ptr_frame_info = to_frame_info(EXTRACT_ADDRESS(page_table_entry));
+			if (page_table_entry & PERM_MODIFIED)
+				LIST_REMOVE(&MemFrameLists.modified_frame_list, ptr_frame_info);
+			else
+			{
+				LIST_REMOVE(&MemFrameLists.free_frame_list, ptr_frame_info);
+				MemFrameLists.num_free_buffered--;
+			}
+			ptr_frame_info->isBuffered = 0;
+			ptr_frame_info->proc = NULL;
+			ptr_frame_info->va = 0;
+			ptr_frame_info->references = 1;
+			ptr_page_table[PTX(va)] = (page_table_entry | PERM_PRESENT) & ~PERM_BUFFERED;
+			env->nPageReclaimed++;
+		}
+	}
+	release_kspinlock(&MemFrameLists.mfllock);
+	return ptr_frame_info;
+}
+
+//===============================
+// CLOCK REPLACEMENT
+//===============================
+//The WS list is a ring (its elements are slots of the env's page_WS_ring) whose clock hand is
+//page_last_WS_element. The element of a victim is recycled in place for the faulted page and
+//the hand moves past it, so the order of the list is kept.
+static inline struct WorkingSetElement* ws_ring_next(struct Env* e, struct WorkingSetElement* wse)
+{
+	struct WorkingSetElement* next = LIST_NEXT(wse);
+	return (next != NULL) ? next : LIST_FIRST(&(e->page_WS_list));
+}
+
+//Number of sweeps after which an unused page is replaced: 1 for CLOCK, N for Nth chance CLOCK
+//(N+1 for a modified page in its MODIFIED version, i.e. page_WS_max_sweeps = -N)
+static inline uint32 clock_max_sweeps(uint32 page_table_entry)
+{
+	if (!isPageReplacmentAlgorithmNchanceCLOCK())
+		return 1;
+	if (page_WS_max_sweeps > 0)
+		return page_WS_max_sweeps;
+	return -page_WS_max_sweeps + ((page_table_entry & PERM_MODIFIED) ? 1 : 0);
+}
+
+//FAST Nth chance CLOCK: once the hand made a full revolution, no page is used any more, so each
+//page is just swept once per revolution till one reaches its max sweeps. Instead of making these
+//revolutions, find the first page (from the hand) that needs the least of them and add to each
+//page the sweeps it would have got meanwhile. Return the victim
+static struct WorkingSetElement* clock_skip_sweeps(struct Env* e, struct WorkingSetElement* hand)
+{
+	struct WorkingSetElement *victim = NULL, *wse = hand;
+	uint32 min_remaining = 0xFFFFFFFF;
+	do
+	{
+		uint32 *ptr_entry = pt_get_page_table_entry(e->env_page_directory, wse->virtual_address);
+		uint32 remaining = clock_max_sweeps(*ptr_entry) - wse->sweeps_counter;
+		if (remaining < min_remaining)
+		{
+			min_remaining = remaining;
+			victim = wse;
+		}
+		wse = ws_ring_next(e, wse);
+	} while (wse != hand);
+
+	//pages after the victim are swept one time less in the last revolution
+	bool after_victim = 0;
+	do
+	{
+		wse->sweeps_counter += after_victim ? min_remaining - 1 : min_remaining;
+		if (wse == victim)
+			after_victim = 1;
+		wse = ws_ring_next(e, wse);
+	} while (wse != hand);
+	return victim;
+}
+
+//Move the hand (from page_last_WS_element) till a victim: a used page gets its used bit cleared
+//and its sweeps reset, an unused one is swept once more and it's the victim once it reaches its
+//max sweeps. The used bit is tested & cleared through a single lookup of the PTE.
+//Return the victim (the hand is left on it)
+static struct WorkingSetElement* clock_select_victim(struct Env* e)
+{
+	struct WorkingSetElement* wse = e->page_last_WS_element;
+	if (wse == NULL)
+		wse = LIST_FIRST(&(e->page_WS_list));
+	uint32 ws_size = LIST_SIZE(&(e->page_WS_list));
+	for (uint32 num_visited = 0; ; num_visited++, wse = ws_ring_next(e, wse))
+	{
+		if (FASTNchanceCLOCK && num_visited == ws_size)
+			return clock_skip_sweeps(e, wse);
+		uint32 *ptr_entry = pt_get_page_table_entry(e->env_page_directory, wse->virtual_address);
+		assert(ptr_entry != NULL);
+		if (*ptr_entry & PERM_USED)
+		{
+			env_page_ws_note_used(e, wse);
+			*ptr_entry &= ~PERM_USED;
+			tlb_invalidate(e->env_page_directory, (void*)wse->virtual_address);
+			wse->sweeps_counter = 0;
+		}
+		else if (++(wse->sweeps_counter) >= clock_max_sweeps(*ptr_entry))
+			return wse;
+	}
+}
+
+//Modified CLOCK (enhanced second chance), from the hand (page_last_WS_element):
+//	Try 1: a full revolution looking for a page that is neither used nor modified, without
+//	       changing anything: it's dropped with no write since its page-file copy is valid.
+//	Try 2: a full revolution looking for an unused page (thus modified, to be written back),
+//	       clearing the used bits on the way.
+//	If none, all used bits are now cleared: repeat.
+//Return the victim (the hand is left on it)
+static struct WorkingSetElement* modified_clock_select_victim(struct Env* e)
+{
+	struct WorkingSetElement* hand = e->page_last_WS_element;
+	if (hand == NULL)
+		hand = LIST_FIRST(&(e->page_WS_list));
+	struct WorkingSetElement* wse;
+	while (1)
+	{
+		wse = hand;
+		do
+		{
+			uint32 *ptr_entry = pt_get_page_table_entry(e->env_page_directory, wse->virtual_address);
+			assert(ptr_entry != NULL);
+			if ((*ptr_entry & (PERM_USED | PERM_MODIFIED)) == 0)
+				return wse;
+			wse = ws_ring_next(e, wse);
+		} while (wse != hand);
+
+		do
+		{
+			uint32 *ptr_entry = pt_get_page_table_entry(e->env_page_directory, wse->virtual_address);
+			if ((*ptr_entry & PERM_USED) == 0)
+				return wse;
+			env_page_ws_note_used(e, wse);
+			*ptr_entry &= ~PERM_USED;
+			tlb_invalidate(e->env_page_directory, (void*)wse->virtual_address);
+			wse = ws_ring_next(e, wse);
+		} while (wse != hand);
+	}
+}
+
 //===============================
 // FAULT HANDLERS
 //===============================
@@ -71,6 +424,7 @@ void fault_handler_init()
 	enableBuffering(0);
 	enableModifiedBuffer(0) ;
 	setModifiedBufferLength(1000);
+	setFaultAroundWindow(0);
 }
 //==================
 // [1] MAIN HANDLER:
@@ -241,8 +595,8 @@ void fault_handler(struct Trapframe *tf)
 	}
 
 	/*************************************************************/
-	//Refresh the TLB cache
-	tlbflush();
+	//Refresh the TLB entry of the faulted page (the handlers invalidate any other page they change)
+	invlpg((void*)ROUNDDOWN(fault_va, PAGE_SIZE));
 	/*************************************************************/
 }
 
@@ -269,111 +623,360 @@ void table_fault_handler(struct Env * curenv, uint32 fault_va)
 //=========================
 // [3] PAGE FAULT HANDLER:
 //=========================
+//OPTIMAL: a page of the stream, in a hash table (open addressing) of the pages referenced
+#define OPT_NEVER_USED 0xFFFFFFFF
+struct opt_page
+{
+	uint32 key;				//page # + 1, 0 if the slot is empty
+	uint32 next_use;		//index of the next run of this page
+	int heap_index;			//index in the heap of the resident pages, -1 if not resident
+};
+
+static struct opt_page* opt_lookup(struct opt_page *table, uint32 mask, uint32 page_number)
+{
+	uint32 i = (page_number * 2654435761u) & mask;
+	while (table[i].key != 0 && table[i].key != page_number + 1)
+		i = (i + 1) & mask;
+	if (table[i].key == 0)
+	{
+		table[i].key = page_number + 1;
+		table[i].next_use = OPT_NEVER_USED;
+		table[i].heap_index = -1;
+	}
+	return &table[i];
+}
+
+//Max-heap of the resident pages on their next use
+static void opt_heap_sift_up(struct opt_page **heap, int i)
+{
+	struct opt_page *p = heap[i];
+	while (i > 0 && heap[(i - 1) / 2]->next_use < p->next_use)
+	{
+		heap[i] = heap[(i - 1) / 2];
+		heap[i]->heap_index = i;
+		i = (i - 1) / 2;
+	}
+	heap[i] = p;
+	p->heap_index = i;
+}
+
+static void opt_heap_sift_down(struct opt_page **heap, int size, int i)
+{
+	struct opt_page *p = heap[i];
+	while (2 * i + 1 < size)
+	{
+		int c = 2 * i + 1;
+		if (c + 1 < size && heap[c + 1]->next_use > heap[c]->next_use)
+			c++;
+		if (heap[c]->next_use <= p->next_use)
+			break;
+		heap[i] = heap[c];
+		heap[i]->heap_index = i;
+		i = c;
+	}
+	heap[i] = p;
+	p->heap_index = i;
+}
+
 /* Calculate the number of page faults according th the OPTIMAL replacement strategy
  * Given:
  * 	1. Initial Working Set List (that the process started with)
  * 	2. Max Working Set Size
- * 	3. Page References List (contains the stream of referenced VAs till the process finished)
+ * 	3. Page References Stream (contains the stream of referenced VAs till the process finished)
  *
  * 	IMPORTANT: This function SHOULD NOT change any of the given lists
+ *
+ * Each run of the stream counts as one reference (the repeats of a page never fault). The next
+ * use of each run is found by one backward pass, then the resident pages are kept in a max-heap
+ * on their next use: a hit updates its key and a fault replaces the root, in O(log maxWSSize)
  */
-int get_optimal_num_faults(struct WS_List *initWorkingSet, int maxWSSize, struct PageRef_List *pageReferences)
+int get_optimal_num_faults(struct WS_List *initWorkingSet, int maxWSSize, struct PageRefStream *pageReferences)
 {
-	//TODO: [PROJECT'25.IM#1] FAULT HANDLER II - #2 get_optimal_num_faults
-	//Your code is here
-	//Comment the following line
-	panic("get_optimal_num_faults() is not implemented yet...!!");
-}
-
-void page_fault_handler(struct Env * faulted_env, uint32 fault_va)
-{
-#if USE_KHEAP
-	struct WorkingSetElement *victimWSElement = NULL;
-	uint32 wsSize = LIST_SIZE(&(faulted_env->page_WS_list));
-#else
-	int iWS =faulted_env->page_last_WS_index;
-	uint32 wsSize = env_page_ws_get_size(faulted_env);
-#endif
-	if (wsSize < (faulted_env->page_WS_max_size))
-	            {
-	                //cprintf("[PF DEBUG] Entering PLACEMENT for VA = %x\n", fault_va);
-	                uint32 va =fault_va;
-
-	                struct FrameInfo *frame = NULL;
-	                allocate_frame(&frame);
-	                if(frame== NULL){
-	                    panic("No free frames in placement");
-	                }
-
-	                bool is_user_heap  = (va >= USER_HEAP_START && va < USER_HEAP_MAX);
-	                bool is_user_stack = (va >= USTACKBOTTOM && va < USTACKTOP);
+	assert(maxWSSize > 0);
+	uint32 num_runs = pageReferences->num_runs;
+	struct PageRefRun *runs = pageReferences->runs;
+
+	//the table can't hold more than the # of user pages
+	uint32 capacity = 1;
+	while (capacity < 2 * (num_runs + maxWSSize) && capacity < 2 * (USER_TOP >> PGSHIFT))
+		capacity <<= 1;
+	struct opt_page *table = kmalloc(capacity * sizeof(struct opt_page));
+	uint32 *next_use = kmalloc((num_runs + 1) * sizeof(uint32));
+	struct opt_page **heap = kmalloc(maxWSSize * sizeof(struct opt_page*));
+	if (table == NULL || next_use == NULL || heap == NULL)
+		panic("get_optimal_num_faults: no kernel heap space for a stream of %d runs", num_runs);
+	memset(table, 0, capacity * sizeof(struct opt_page));
+
+	//1. Next use of each run; at the end, the next use of each page is its first use
+	for (int i = (int)num_runs - 1; i >= 0; i--)
+	{
+		struct opt_page *p = opt_lookup(table, capacity - 1, runs[i].page_number);
+		next_use[i] = p->next_use;
+		p->next_use = i;
+	}
 
-	                uint32 map_perms = PERM_USER | PERM_WRITEABLE;
-	                map_frame(faulted_env->env_page_directory, frame, va, map_perms);
+	//2. The initial WS is resident
+	int heap_size = 0;
+	struct WorkingSetElement *wse;
+	LIST_FOREACH(wse, initWorkingSet)
+	{
+		if (heap_size == maxWSSize)
+			break;
+		struct opt_page *p = opt_lookup(table, capacity - 1, wse->virtual_address >> PGSHIFT);
+		if (p->heap_index >= 0)
+			continue;
+		heap[heap_size] = p;
+		opt_heap_sift_up(heap, heap_size++);
+	}
 
-	                int r = pf_read_env_page(faulted_env, (void*)va);
+	//3. Replay the stream, replacing the page used the farthest in the future
+	int num_faults = 0;
+	for (uint32 i = 0; i < num_runs; i++)
+	{
+		struct opt_page *p = opt_lookup(table, capacity - 1, runs[i].page_number);
+		p->next_use = next_use[i];
+		if (p->heap_index >= 0)
+		{
+			//its next use only gets farther
+			opt_heap_sift_up(heap, p->heap_index);
+			continue;
+		}
+		num_faults++;
+		if (heap_size == maxWSSize)
+		{
+			heap[0]->heap_index = -1;
+			heap[0] = p;
+			opt_heap_sift_down(heap, heap_size, 0);
+		}
+		else
+		{
+			heap[heap_size] = p;
+			opt_heap_sift_up(heap, heap_size++);
+		}
+	}
 
-	                if (r == E_PAGE_NOT_EXIST_IN_PF)
-	                {
-	                    if (!(is_user_heap || is_user_stack))
-	                    {
-	                        unmap_frame(faulted_env->env_page_directory, va);
-	                        //cprintf("[PF] placement: page not in PF and not stack/heap -> kill env (va=%x)\n", va);
-	                        env_exit();
+	kfree(table);
+	kfree(next_use);
+	kfree(heap);
+	return num_faults;
+}
 
-	                    }}
-	                fault_va=ROUNDDOWN(va,PAGE_SIZE);
-	                struct WorkingSetElement* b = env_page_ws_list_create_element(faulted_env, fault_va);
+//Bring the page at 'va' of 'e' into memory: a new frame is mapped then filled from the page
+//file, or zero-filled for a heap/stack page that isn't there yet. Any other page that isn't in
+//the page file is an invalid access: the env is killed
+static void page_in(struct Env* e, uint32 va)
+{
+	bool is_user_heap  = (va >= USER_HEAP_START && va < USER_HEAP_MAX);
+	bool is_user_stack = (va >= USTACKBOTTOM && va < USTACKTOP);
 
+	struct FrameInfo *frame = NULL;
+	if (is_user_heap || is_user_stack)
+		allocate_zeroed_frame(&frame);
+	else
+		allocate_frame(&frame);
+	if (frame == NULL)
+		panic("No free frames in placement");
+	map_frame(e->env_page_directory, frame, va, PERM_USER | PERM_WRITEABLE);
 
-	                       if(faulted_env->page_last_WS_element == NULL){
-	                           LIST_INSERT_TAIL(&(faulted_env->page_WS_list), b);
+	int r = pf_read_env_page(e, (void*)va);
+	if (r == E_PAGE_NOT_EXIST_IN_PF && !(is_user_heap || is_user_stack))
+	{
+		unmap_frame(e->env_page_directory, va);
+		env_exit();
+	}
+}
 
-	                           if (LIST_SIZE(&(faulted_env->page_WS_list)) == faulted_env->page_WS_max_size)
-	                               faulted_env->page_last_WS_element = LIST_FIRST(&(faulted_env->page_WS_list));
-	                       }
-	                       else
-	                           LIST_INSERT_BEFORE(&(faulted_env->page_WS_list), faulted_env->page_last_WS_element, b);
+//A neighbour of a faulted page can be prefetched if it's not in memory (neither mapped nor
+//buffered, and its page table exists) and its page-file copy is on the disk frame 'dfn'
+static inline bool fault_around_can_prefetch(struct Env* e, uint32 va, uint32 dfn)
+{
+	if (va >= USER_TOP)
+		return 0;
+	uint32 *ptr_entry = pt_get_page_table_entry(e->env_page_directory, va);
+	if (ptr_entry == NULL || EXTRACT_ADDRESS(*ptr_entry) != 0 || (*ptr_entry & (PERM_PRESENT | PERM_BUFFERED)))
+		return 0;
+	return pf_get_env_page_dfn(e, va) == dfn;
+}
 
-	                        //env_page_ws_print(faulted_env);
+//Fault-around: page in the faulted page at 'va' (its page-file copy is on 'dfn') with up to
+//'max_prefetch' of its neighbours: the run of consecutive pages around it whose copies are on
+//consecutive disk frames, so that the whole run is read by a single disk command. The prefetched
+//pages are left not used, only a reference by the user code counts.
+//Return the 1st page of the run in 'first_va' and its # of pages in 'num_pages'
+static void fault_around_page_in(struct Env* e, uint32 va, uint32 dfn, uint32 max_prefetch, uint32 *first_va, uint32 *num_pages)
+{
+	uint32 before = 0, after = 0;
+	//pages after the faulted one first: programs mostly go upwards through their pages
+	while (before + after < max_prefetch &&
+			fault_around_can_prefetch(e, va + (after + 1) * PAGE_SIZE, dfn + after + 1))
+		after++;
+	while (before + after < max_prefetch && va >= (before + 1) * PAGE_SIZE && dfn > before + 1 &&
+			fault_around_can_prefetch(e, va - (before + 1) * PAGE_SIZE, dfn - (before + 1)))
+		before++;
+
+	*first_va = va - before * PAGE_SIZE;
+	*num_pages = before + 1 + after;
+	for (uint32 i = 0; i < *num_pages; i++)
+	{
+		struct FrameInfo *frame = NULL;
+		allocate_frame(&frame);
+		if (frame == NULL)
+			panic("No free frames in placement");
+		map_frame(e->env_page_directory, frame, *first_va + i * PAGE_SIZE, PERM_USER | PERM_WRITEABLE);
+	}
+	pf_read_env_pages(e, *first_va, *num_pages);
+	for (uint32 i = 0; i < *num_pages; i++)
+	{
+		if (i != before)
+			pt_set_page_permissions(e->env_page_directory, *first_va + i * PAGE_SIZE, 0, PERM_USED);
+	}
+	e->nPagePrefetched += *num_pages - 1;
+}
 
-	                }
+//Add a new WS element for the page at 'va' behind the clock hand or, while the WS isn't full
+//yet, at its tail (the hand is set on the first element once it's full)
+static void ws_insert_new_element(struct Env* e, uint32 va, bool prefetched)
+{
+	struct WorkingSetElement* wse = env_page_ws_list_create_element(e, va);
+	wse->prefetched = prefetched;
+	if (e->page_last_WS_element == NULL)
+	{
+		LIST_INSERT_TAIL(&(e->page_WS_list), wse);
+		if (LIST_SIZE(&(e->page_WS_list)) == e->page_WS_max_size)
+			e->page_last_WS_element = LIST_FIRST(&(e->page_WS_list));
+	}
 	else
+		LIST_INSERT_BEFORE(&(e->page_WS_list), e->page_last_WS_element, wse);
+}
+
+//OPTIMAL: the WS is kept as it was loaded and the faults just record the reference stream (the
+//# of faults is calculated later by get_optimal_num_faults). To catch each change of the page
+//referenced, the pages of the "active" set (initially the loaded WS) stay present only till it's
+//full: then they're all made not present (keeping their frames) and the set restarts.
+static void optimal_page_fault(struct Env* e, uint32 fault_va)
+{
+	fault_va = ROUNDDOWN(fault_va, PAGE_SIZE);
+	if (e->optimal_active_VAs == NULL)
 	{
-		if (isPageReplacmentAlgorithmOPTIMAL())
+		e->optimal_active_VAs = kmalloc(e->page_WS_max_size * sizeof(uint32));
+		if (e->optimal_active_VAs == NULL)
+			panic("optimal_page_fault: can't create the active set");
+		e->optimal_num_active = 0;
+		struct WorkingSetElement *wse;
+		LIST_FOREACH(wse, &(e->page_WS_list))
 		{
-			//TODO: [PROJECT'25.IM#1] FAULT HANDLER II - #1 Optimal Reference Stream
-			//Your code is here
-			//Comment the following line
-			panic("page_fault_handler().REPLACEMENT is not implemented yet...!!");
+			e->optimal_active_VAs[e->optimal_num_active++] = wse->virtual_address;
 		}
-		else if (isPageReplacmentAlgorithmCLOCK())
+	}
+	if (e->optimal_num_active >= e->page_WS_max_size)
+	{
+		for (uint32 i = 0; i < e->optimal_num_active; i++)
+			pt_set_page_permissions(e->env_page_directory, e->optimal_active_VAs[i], 0, PERM_PRESENT);
+		e->optimal_num_active = 0;
+	}
+
+	uint32 *ptr_entry = pt_get_page_table_entry(e->env_page_directory, fault_va);
+	if (ptr_entry != NULL && EXTRACT_ADDRESS(*ptr_entry) != 0)
+		pt_set_page_permissions(e->env_page_directory, fault_va, PERM_PRESENT, 0);
+	else
+		page_in(e, fault_va);
+
+	e->optimal_active_VAs[e->optimal_num_active++] = fault_va;
+	env_page_ref_stream_add(e, fault_va);
+}
+
+void page_fault_handler(struct Env * faulted_env, uint32 fault_va)
+{
+#if USE_KHEAP
+	if (isPageReplacmentAlgorithmOPTIMAL())
+	{
+		optimal_page_fault(faulted_env, fault_va);
+		return;
+	}
+	struct WorkingSetElement *victimWSElement = NULL;
+	uint32 wsSize = LIST_SIZE(&(faulted_env->page_WS_list));
+#else
+	int iWS =faulted_env->page_last_WS_index;
+	uint32 wsSize = env_page_ws_get_size(faulted_env);
+#endif
+	//REPLACEMENT: if the WS is full, the victim (selected by the replacement algorithm) is paged out
+	//by page_out_victim() and its WS element is recycled for the faulted page below, the clock hand
+	//(page_last_WS_element) being moved to the next element
+	if (wsSize >= (faulted_env->page_WS_max_size))
+	{
+		if (isPageReplacmentAlgorithmCLOCK() || isPageReplacmentAlgorithmNchanceCLOCK())
 		{
-			//TODO: [PROJECT'25.IM#1] FAULT HANDLER II - #3 Clock Replacement
-			//Your code is here
-			//Comment the following line
-			panic("page_fault_handler().REPLACEMENT is not implemented yet...!!");
+			victimWSElement = clock_select_victim(faulted_env);
 		}
 		else if (isPageReplacmentAlgorithmLRU(PG_REP_LRU_TIME_APPROX))
 		{
-			//TODO: [PROJECT'25.IM#6] FAULT HANDLER II - #2 LRU Aging Replacement
-			//Your code is here
-			//Comment the following line
-			panic("page_fault_handler().REPLACEMENT is not implemented yet...!!");
+			victimWSElement = env_page_ws_lru_select_victim(faulted_env);
 		}
 		else if (isPageReplacmentAlgorithmModifiedCLOCK())
 		{
-			//TODO: [PROJECT'25.IM#6] FAULT HANDLER II - #3 Modified Clock Replacement
-			//Your code is here
-			//Comment the following line
-			panic("page_fault_handler().REPLACEMENT is not implemented yet...!!");
+			//a clean victim is just dropped, a modified one is written back (or buffered) by page_out_victim()
+			victimWSElement = modified_clock_select_victim(faulted_env);
+		}
+		else
+		{
+			//the WS must never grow beyond its max size
+			panic("page_fault_handler(): replacement not supported for this algorithm");
+		}
+		if (victimWSElement != NULL)
+		{
+			page_out_victim(faulted_env, victimWSElement->virtual_address);
+			faulted_env->page_last_WS_element = ws_ring_next(faulted_env, victimWSElement);
 		}
 	}
+	//PLACEMENT
+	            {
+	                //cprintf("[PF DEBUG] Entering PLACEMENT for VA = %x\n", fault_va);
+	                uint32 va =fault_va;
+
+	                //a page that is still buffered is reclaimed with its content (soft fault)
+	                struct FrameInfo *frame = NULL;
+	                if (isBufferingEnabled())
+	                    frame = page_buffer_reclaim(faulted_env, ROUNDDOWN(va, PAGE_SIZE));
+	                fault_va=ROUNDDOWN(va,PAGE_SIZE);
+	                uint32 first_va = fault_va, num_pages = 1;
+	                if (frame == NULL)
+	                {
+	                    //fault-around: neighbours are prefetched into the free WS slots only
+	                    uint32 max_prefetch = 0;
+	                    if (victimWSElement == NULL && wsSize + 1 < faulted_env->page_WS_max_size && !is_memory_scarce())
+	                        max_prefetch = MIN(getFaultAroundWindow(), faulted_env->page_WS_max_size - wsSize - 1);
+	                    uint32 dfn = (max_prefetch > 0) ? pf_get_env_page_dfn(faulted_env, fault_va) : 0;
+	                    if (dfn != 0)
+	                        fault_around_page_in(faulted_env, fault_va, dfn, max_prefetch, &first_va, &num_pages);
+	                    else
+	                        page_in(faulted_env, va);
+	                }
+	                if (victimWSElement != NULL)
+	                {
+	                    //the faulted page takes the slot of the victim, behind the clock hand
+	                    victimWSElement->virtual_address = fault_va;
+	                    victimWSElement->prefetched = 0;
+	                    victimWSElement->time_stamp = 0;
+	                    victimWSElement->sweeps_counter = 0;
+	                    return;
+	                }
+	                ws_insert_new_element(faulted_env, fault_va, 0);
+	                for (uint32 i = 0; i < num_pages; i++)
+	                {
+	                    if (first_va + i * PAGE_SIZE != fault_va)
+	                        ws_insert_new_element(faulted_env, first_va + i * PAGE_SIZE, 1);
+	                }
+
+	                        //env_page_ws_print(faulted_env);
+
+	                }
 }
 
+//Buffering is handled by page_fault_handler() itself: a page that is still buffered on the free
+//or modified list is reclaimed instead of being read from the page file
 void __page_fault_handler_with_buffering(struct Env * curenv, uint32 fault_va)
 {
-	panic("this function is not required...!!");
+	page_fault_handler(curenv, fault_va);
 }
 
 
@@ -18,6 +18,7 @@
 /******************************/
 uint32 _EnableModifiedBuffer ;
 uint32 _EnableBuffering ;
+uint32 _FaultAroundWindow ;
 
 uint32 _PageRepAlgoType;
 #define PG_REP_LRU_TIME_APPROX 	0x1
@@ -66,6 +67,14 @@ void enableBuffering(uint32 enableIt);
 uint8 isBufferingEnabled() ;
 void setModifiedBufferLength(uint32 length) ;
 uint32 getModifiedBufferLength();
+void page_out_victim(struct Env* env, uint32 va);
+void page_buffer_flush_modified();
+
+//===============================
+// FAULT-AROUND (PREPAGING)
+//===============================
+void setFaultAroundWindow(uint32 num_of_pages);
+uint32 getFaultAroundWindow();
 
 //===============================
 // FAULT HANDLERS
@@ -76,5 +85,5 @@ void __page_fault_handler_with_buffering(struct Env * curenv, uint32 fault_va);
 void dyn_alloc_local_scope_method(struct Env * curenv, uint32 fault_va);
 void page_fault_handler(struct Env * curenv, uint32 fault_va);
 void table_fault_handler(struct Env * curenv, uint32 fault_va);
-/*2025*/ int get_optimal_num_faults(struct WS_List *initWorkingSet, int maxWSSize, struct PageRef_List *pageReferences);
+/*2025*/ int get_optimal_num_faults(struct WS_List *initWorkingSet, int maxWSSize, struct PageRefStream *pageReferences);
 #endif /* KERN_FAULT_HANDLER_H_ */
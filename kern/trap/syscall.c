@@ -251,7 +251,7 @@ void sys_clearFFL()
 	int size;
 	acquire_kspinlock(&MemFrameLists.mfllock);
 	{
-		size = LIST_SIZE(&MemFrameLists.free_frame_list) ;
+		size = count_free_frames() ;
 		struct FrameInfo* ptr_tmp_FI ;
 		for (int i = 0; i < size ; i++)
 		{
@@ -496,7 +496,7 @@ int sys_get_optimal_num_faults()
 			panic("sys_get_optimal_num_faults(): page working set is changed during the OPTIMAL replacement while it's not expected to");
 		}
 	}
-	return get_optimal_num_faults(&(cur_env->page_WS_list), cur_env->page_WS_max_size, &(cur_env->referenceStreamList));
+	return get_optimal_num_faults(&(cur_env->page_WS_list), cur_env->page_WS_max_size, &(cur_env->referenceStream));
 #else
 	panic("MUST ENABLE KHEAP");
 #endif
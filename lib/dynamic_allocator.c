@@ -8,6 +8,17 @@
 #include <inc/string.h>
 #include "../inc/dynamic_allocator.h"
 
+//The arena table is read without any lock (e.g. by kfree() to tell a block from pages), while
+//add_arena() may append to it under the lock of the DA. It's published through the count: an
+//entry is filled in, then a barrier, then dynAllocNumOfArenas is incremented; entries are never
+//changed or removed afterwards. A reader takes the count once and only looks below it
+static __inline__ uint32 get_num_of_published_arenas(void)
+{
+	uint32 num_of_arenas = *(volatile uint32 *)&dynAllocNumOfArenas;
+	__sync_synchronize();
+	return num_of_arenas;
+}
+
 //==================================================================================//
 //============================== GIVEN FUNCTIONS ===================================//
 //==================================================================================//
@@ -18,7 +29,17 @@
 __inline__ uint32 to_page_va(struct PageInfoElement *ptrPageInfo)
 {
 	if (ptrPageInfo < &pageBlockInfoArr[0] || ptrPageInfo >= &pageBlockInfoArr[DYN_ALLOC_MAX_SIZE/PAGE_SIZE])
-			panic("to_page_va called with invalid pageInfoPtr");
+	{
+		//Not in the main table: it must belong to one of the extra arenas
+		uint32 num_of_arenas = get_num_of_published_arenas();
+		for (int i = 0; i < num_of_arenas; i++)
+		{
+			struct DAArena *arena = &dynAllocArenas[i];
+			if (ptrPageInfo >= arena->pageInfoArr && ptrPageInfo < arena->pageInfoArr + arena->num_of_pages)
+				return arena->start + ((ptrPageInfo - arena->pageInfoArr) << PGSHIFT);
+		}
+		panic("to_page_va called with invalid pageInfoPtr");
+	}
 	//Get start VA of the 	page from the corresponding Page Info pointer
 	int idxInPageInfoArr = (ptrPageInfo - pageBlockInfoArr);
 	return dynAllocStart + (idxInPageInfoArr << PGSHIFT);
@@ -30,11 +51,33 @@ __inline__ uint32 to_page_va(struct PageInfoElement *ptrPageInfo)
 __inline__ struct PageInfoElement * to_page_info(uint32 va)
 {
 	int idxInPageInfoArr = (va - dynAllocStart) >> PGSHIFT;
-	if (idxInPageInfoArr < 0 || idxInPageInfoArr >= DYN_ALLOC_MAX_SIZE/PAGE_SIZE)
-		panic("to_page_info called with invalid pa");
+	if (idxInPageInfoArr < 0 || idxInPageInfoArr >= DYN_ALLOC_MAX_SIZE/PAGE_SIZE || va >= dynAllocEnd)
+	{
+		//Not in the main window: it must belong to one of the extra arenas
+		struct DAArena *arena = get_dynamic_allocator_arena(va);
+		if (arena == NULL)
+			panic("to_page_info called with invalid pa");
+		return &arena->pageInfoArr[(va - arena->start) >> PGSHIFT];
+	}
 	return &pageBlockInfoArr[idxInPageInfoArr];
 }
 
+//==================================
+// [3] GET ARENA OF VA:
+//==================================
+//Return the extra arena whose block pages contain va, NULL if va is not inside any of them
+struct DAArena* get_dynamic_allocator_arena(uint32 va)
+{
+	uint32 num_of_arenas = get_num_of_published_arenas();
+	for (int i = 0; i < num_of_arenas; i++)
+	{
+		struct DAArena *arena = &dynAllocArenas[i];
+		if (va >= arena->start && va < arena->start + arena->num_of_pages * PAGE_SIZE)
+			return arena;
+	}
+	return NULL;
+}
+
 //==================================================================================//
 //============================ REQUIRED FUNCTIONS ==================================//
 //==================================================================================//
@@ -84,10 +127,13 @@ void initialize_dynamic_allocator(uint32 daStart, uint32 daEnd)
 
 
 
-		for(int i=0; i < (LOG2_MAX_SIZE - LOG2_MIN_SIZE + 1); i++ )
+		for(int i=0; i < NUM_OF_BLOCK_CLASSES; i++ )
 		{
 			LIST_INIT(&freeBlockLists[i]);
+			dynAllocNumOfEmptyPages[i] = 0;
 		}
+		dynAllocMaxEmptyPages = DYN_ALLOC_DEFAULT_EMPTY_PAGES;
+		dynAllocNumOfArenas = 0;
 
 
 
@@ -114,6 +160,44 @@ __inline__ uint32 get_block_size(void *va)
 
 }
 
+//Take one free block of the given page into use (the page leaves the empty-page cache if it was there)
+static __inline__ void take_block_of_page(struct PageInfoElement *ptrPageInfo)
+{
+	if (ptrPageInfo->num_of_free_blocks == PAGE_SIZE / ptrPageInfo->block_size)
+		dynAllocNumOfEmptyPages[size_to_class(ptrPageInfo->block_size)]--;
+	ptrPageInfo->num_of_free_blocks--;
+}
+
+//Claim a new arena from the page allocator, map its PageInfoElement table and add its pages to
+//freePagesList. Return 0 if no more arenas can be added. As for any DA page, get_page() panics
+//if no frame is left for the table. Called with the lock of the DA held (kheap_spinlock in the
+//kernel)
+static int add_arena(void)
+{
+	if (dynAllocNumOfArenas == DYN_ALLOC_MAX_ARENAS)
+		return 0;
+	uint32 arena_va = (uint32)get_arena(DYN_ALLOC_ARENA_SIZE);
+	if (arena_va == 0)
+		return 0;
+
+	uint32 total_pages = DYN_ALLOC_ARENA_SIZE / PAGE_SIZE;
+	uint32 table_pages = ROUNDUP(total_pages * sizeof(struct PageInfoElement), PAGE_SIZE) / PAGE_SIZE;
+	for (int i = 0; i < table_pages; i++)
+		get_page((void*)(arena_va + i * PAGE_SIZE));
+
+	//fill the arena in before publishing it (see get_num_of_published_arenas)
+	struct DAArena *arena = &dynAllocArenas[dynAllocNumOfArenas];
+	arena->pageInfoArr = (struct PageInfoElement *)arena_va;
+	arena->start = arena_va + table_pages * PAGE_SIZE;
+	arena->num_of_pages = total_pages - table_pages;
+	memset(arena->pageInfoArr, 0, arena->num_of_pages * sizeof(struct PageInfoElement));
+	for (int i = 0; i < arena->num_of_pages; i++)
+		LIST_INSERT_TAIL(&freePagesList, &arena->pageInfoArr[i]);
+	__sync_synchronize();
+	dynAllocNumOfArenas++;
+	return 1;
+}
+
 //===========================
 // 3) ALLOCATE BLOCK:
 //===========================
@@ -142,18 +226,9 @@ void *alloc_block(uint32 size)
 		panic("size out of lower/upper limit");
 		return NULL;
 	}
-	else{ // rounding size
-		for ( int i=3; i<=11; i++)
-			{
-				uint32 power =1<<i;
-
-				if (size <= power)
-				{
-					size = power;
-					arr_index = i-3;
-					break;
-				}
-			}
+	else{ // rounding size up to its class
+		arr_index = size_to_class(size);
+		size = class_to_size(arr_index);
 	}
 
 
@@ -179,7 +254,7 @@ void *alloc_block(uint32 size)
 			block_info_entry = to_page_info(page_start);
 
 			if(block_info_entry != NULL) {
-				block_info_entry->num_of_free_blocks--;
+				take_block_of_page(block_info_entry);
 			}
 
 			return (void*)found_block;
@@ -214,7 +289,7 @@ void *alloc_block(uint32 size)
 		//CASE 3
 		else
 		{
-			for(int i = arr_index + 1; i < (LOG2_MAX_SIZE - LOG2_MIN_SIZE + 1); i++){
+			for(int i = arr_index + 1; i < NUM_OF_BLOCK_CLASSES; i++){
 				if(LIST_SIZE(&freeBlockLists[i]) != 0)
 				{
 					// Found a bigger block, allocate it as-is
@@ -225,13 +300,15 @@ void *alloc_block(uint32 size)
 					uint32 page_start = ROUNDDOWN(block_va, PAGE_SIZE);
 					block_info_entry = to_page_info(page_start);
 					if(block_info_entry != NULL) {
-						block_info_entry->num_of_free_blocks--;
+						take_block_of_page(block_info_entry);
 						}
 					return (void*)found_block;
 					}
 				}
-			//case 4
-			panic("case 4");
+			//case 4: no free page or bigger block is left, grow the DA by a new arena and retry
+			if (add_arena())
+				return alloc_block(size);
+			return NULL;
 			}
 }
 
@@ -240,6 +317,22 @@ void *alloc_block(uint32 size)
 	//TODO: [PROJECT'25.BONUS#1] DYNAMIC ALLOCATOR - block if no free block
 
 
+//Unlink all blocks of an entirely free page and give the page back to the kernel
+static void release_empty_page(struct PageInfoElement *page_info)
+{
+	uint32 block_size = page_info->block_size;
+	uint32 arr_index = size_to_class(block_size);
+	uint32 page_va = to_page_va(page_info);
+	for (int i = 0; i < PAGE_SIZE / block_size; i++)
+	{
+		LIST_REMOVE(&freeBlockLists[arr_index], (struct BlockElement *)(page_va + i * block_size));
+	}
+	page_info->block_size = 0;
+	page_info->num_of_free_blocks = 0;
+	return_page((void*)page_va);
+	LIST_INSERT_HEAD(&freePagesList, page_info);
+}
+
 //===========================
 // [4] FREE BLOCK:
 //===========================
@@ -249,7 +342,7 @@ void free_block(void *va)
 	//DON'T CHANGE THESE LINES==========================================================
 	//==================================================================================
 	{
-		assert((uint32)va >= dynAllocStart && (uint32)va < dynAllocEnd);
+		assert(((uint32)va >= dynAllocStart && (uint32)va < dynAllocEnd) || get_dynamic_allocator_arena((uint32)va) != NULL);
 	}
 	//==================================================================================
 	//==================================================================================
@@ -257,7 +350,56 @@ void free_block(void *va)
 	//TODO: [PROJECT'25.GM#1] DYNAMIC ALLOCATOR - #4 free_block
 	//Your code is here
 	//Comment the following line
-	panic("free_block() Not implemented yet");
+	//panic("free_block() Not implemented yet");
+
+	struct PageInfoElement *page_info = to_page_info((uint32)va);
+	uint32 block_size = page_info->block_size;
+	if (block_size == 0)
+		panic("free_block: va %x is not inside an allocated DA page", va);
+	uint32 arr_index = size_to_class(block_size);
+	uint32 blocks_per_page = PAGE_SIZE / block_size;
+
+	//push it at the head so that the next allocation of this size reuses it while it's still warm
+	LIST_INSERT_HEAD(&freeBlockLists[arr_index], (struct BlockElement *)va);
+	page_info->num_of_free_blocks++;
+	if (page_info->num_of_free_blocks < blocks_per_page)
+		return;
+
+	//The page became entirely free: keep it mapped if the cache of this size class isn't full
+	if (dynAllocNumOfEmptyPages[arr_index] < dynAllocMaxEmptyPages)
+	{
+		dynAllocNumOfEmptyPages[arr_index]++;
+		return;
+	}
+
+	release_empty_page(page_info);
+}
+
+//===========================
+// [5] SET EMPTY-PAGE CACHE SIZE:
+//===========================
+//Set the max # of empty pages kept per size class, releasing the cached ones that exceed it
+void set_dynamic_allocator_empty_pages(uint32 maxEmptyPages)
+{
+	dynAllocMaxEmptyPages = maxEmptyPages;
+	uint32 num_pages = (dynAllocEnd - dynAllocStart) / PAGE_SIZE;
+	for (int a = -1; a < (int)dynAllocNumOfArenas; a++)
+	{
+		struct PageInfoElement *table = (a < 0) ? pageBlockInfoArr : dynAllocArenas[a].pageInfoArr;
+		uint32 table_size = (a < 0) ? num_pages : dynAllocArenas[a].num_of_pages;
+		for (int i = 0; i < table_size; i++)
+		{
+			struct PageInfoElement *page_info = &table[i];
+			if (page_info->block_size == 0 || page_info->num_of_free_blocks != PAGE_SIZE / page_info->block_size)
+				continue;
+			uint32 arr_index = size_to_class(page_info->block_size);
+			if (dynAllocNumOfEmptyPages[arr_index] > dynAllocMaxEmptyPages)
+			{
+				dynAllocNumOfEmptyPages[arr_index]--;
+				release_empty_page(page_info);
+			}
+		}
+	}
 }
 
 //==================================================================================//
@@ -270,7 +412,24 @@ void free_block(void *va)
 void *realloc_block(void* va, uint32 new_size)
 {
 	//TODO: [PROJECT'25.BONUS#2] KERNEL REALLOC - realloc_block
-	//Your code is here
-	//Comment the following line
-	panic("realloc_block() Not implemented yet");
+	if (va == NULL)
+		return alloc_block(new_size);
+	if (new_size == 0)
+	{
+		free_block(va);
+		return NULL;
+	}
+	assert(new_size <= DYN_ALLOC_MAX_BLOCK_SIZE);
+
+	//Still fits in its block and doesn't waste more than half of it: keep it in place
+	uint32 old_size = get_block_size(va);
+	if (new_size <= old_size && (new_size > old_size / 2 || old_size == DYN_ALLOC_MIN_BLOCK_SIZE))
+		return va;
+
+	void *new_va = alloc_block(new_size);
+	if (new_va == NULL)
+		return NULL;
+	memcpy(new_va, va, MIN(old_size, new_size));
+	free_block(va);
+	return new_va;
 }
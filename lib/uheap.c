@@ -42,6 +42,20 @@ void return_page(void* va)
 		panic("return_page() in user: failed to return a page to the kernel");
 }
 
+//==============================================
+// [4] GET AN ARENA FROM THE USER HEAP FOR DA:
+//==============================================
+//Reserve (without mapping) an extent at the page allocator break for an extra DA arena. NULL if full
+void* get_arena(uint32 size)
+{
+	size = ROUNDUP(size, PAGE_SIZE);
+	if (size > USER_HEAP_MAX - uheapPageAllocBreak)
+		return NULL;
+	void* va = (void*)uheapPageAllocBreak;
+	uheapPageAllocBreak += size;
+	return va;
+}
+
 //==================================================================================//
 //============================ REQUIRED FUNCTIONS ==================================//
 //==================================================================================//